@@ -0,0 +1,21 @@
+// Buffer cache statistics, from bcstat(); see bio.c.
+// Both the kernel and user programs use this header file.
+
+// replacement policies, for bcctl().
+#define BC_LRU 0    // recycle the least recently used buffer
+#define BC_2Q  1    // ... but blocks used only once go first
+
+struct bcstat {
+  int nbuf;         // buffers in the cache now
+  int maxbuf;       // most it may grow to
+  int policy;       // BC_LRU or BC_2Q
+  uint64 nhit;      // lookups that found the block cached
+  uint64 nmiss;     // lookups that had to read it
+  uint64 nevict;    // blocks recycled to make room
+  uint64 ngrow;     // pages of buffers added
+  uint64 nshrink;   // ... and given back to kalloc()
+  uint64 nahead;    // blocks read ahead
+  uint64 nahit;     // ... that a read then found
+  uint64 nreq;      // disk requests
+  uint64 nreqblk;   // ... and the blocks they moved
+};
@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -12,6 +12,50 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+//
+// Each bucket of the table has its own lock, which protects
+// the list of buffers in the bucket and their refcnt and
+// lastuse, so lookups of different blocks rarely contend.
+// Each bucket keeps its buffers in the order the policy would
+// recycle them. A miss first recycles the first unused buffer
+// of its own bucket, in place, holding no other lock, if that
+// buffer is of the queue the policy recycles from; so LRU is
+// only approximate, per bucket, once the cache stops growing.
+// Only if the bucket has none does the miss take bcache.lock,
+// which serializes moving buffers between buckets, so that
+// only a hart holding it ever holds two bucket locks, and look
+// at the first unused ones of every bucket.
+//
+// Besides the NBUF buffers that are always there, the cache
+// grows a page of buffers at a time (a chunk) on misses, up to
+// 1/BCACHEFRAC of the memory free at boot, and kreclaim() gives
+// chunks back with bshrink() when free memory runs low.
+// When every buffer is in use, bget() has the log's flusher
+// checkpoint and waits for letgo(). bcctl() keeps the cache at
+// least MINBUF, which leaves room past what the log pins, and
+// bget() grows it back to that if kreclaim() shrank it.
+//
+// breadahead() starts reading a block without waiting, for
+// fs.c's read-ahead, bwriteback() starts writing one that a
+// commit left dirty, for the log's flusher, and bwrite_async()
+// ones the log writes itself; the buffer stays locked until
+// the disk interrupt hands it to bdone(). A dirty
+// buffer keeps the log's pin until it is written, and bread()
+// writes it first if the flusher hasn't, so that the disk
+// never sees a later transaction's changes before it commits.
+// While a closed transaction's commit writes it to the log,
+// its buffers are frozen: bread() by anyone but the committer
+// waits until binstall() hands each to the flusher, so the
+// next transaction can run meanwhile but can't change them.
+//
+// Recycling follows one of two policies, set with bcctl().
+// LRU recycles the buffer used least recently. 2Q resists
+// scans, which under LRU push out everything else: a newly
+// read block joins A1, where more uses within a short while
+// don't count, and A1 gives up its oldest buffer first while
+// it holds more than a quarter of the cache. A block used
+// again after A1 recycled it, which NGHOST remembers, joins
+// Am, which is LRU.
 
 
 #include "types.h"
@@ -19,73 +63,718 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
+#include "rusage.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "bcstat.h"
+#include "trace.h"
+
+#define NBUCKET 127
+#define NODEV   (~0U)  // dev of a buffer on the free list
+#define NGHOST  512    // blocks recently recycled from A1
+
+// b->queue under 2Q.
+#define BQ_AM 0
+#define BQ_A1 1
+
+// buffers in a page, after the chunk's next pointer.
+#define BPERCHUNK ((PGSIZE - sizeof(void*)) / sizeof(struct buf))
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;  // buffers whose blocks hash here, through next
+  uint64 nhit;       // lookups found here
+};
+
+// a page of buffers added to the cache.
+struct chunk {
+  struct chunk *next;
+  struct buf buf[BPERCHUNK];
+};
 
 struct {
+  // held while recycling a buffer from another bucket or the
+  // free list, and protects the rest but for what qlock
+  // does and the counts updated atomically.
   struct spinlock lock;
+  struct spinlock frozenlock; // for waits on b->frozen
+  struct spinlock qlock;      // for na1 and the ghosts; taken last
   struct buf buf[NBUF];
-
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  struct buf *free;      // buffers holding no block, through next
+  struct chunk *chunks;
+  int nbuf;              // buffers in all
+  int maxbuf;
+  int nwant;             // bget()s waiting for an unused buffer
+  uint64 nmiss;          // atomic
+  uint64 nevict;         // buffers recycled; atomic
+  uint64 ngrow, nshrink; // chunks added and given back
+  uint64 nahead, nahit;  // blocks read ahead, and found by bread()
+  uint64 nreq, nreqblk;  // disk requests, and blocks they moved
+  int policy;            // BC_LRU or BC_2Q
+  int na1;               // buffers holding blocks in A1
+  struct {
+    uint dev, blockno;
+  } ghost[NGHOST];       // ring of blocks recycled from A1,
+  uint ghostnext;        // next replaced at ghostnext % NGHOST
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+static struct bucket*
+bucket(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bk;
+  int i;
 
   initlock(&bcache.lock, "bcache");
+  initlock(&bcache.frozenlock, "bcache.frozen");
+  initlock(&bcache.qlock, "bcache.queue");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    initlock(&bk->lock, "bcache.bucket");
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->dev = NODEV;
+    b->next = bcache.free;
+    bcache.free = b;
+  }
+  bcache.nbuf = NBUF;
+  bcache.maxbuf = NBUF + kfreepages() / BCACHEFRAC * BPERCHUNK;
+  if(bcache.maxbuf < MINBUF)
+    bcache.maxbuf = MINBUF;
+  for(i = 0; i < NGHOST; i++)
+    bcache.ghost[i].dev = NODEV;
+}
+
+// Add the buffers in page to the free list.
+// Caller holds bcache.lock.
+static void
+addchunk(void *page)
+{
+  struct chunk *c = page;
+  struct buf *b;
+
+  memset(page, 0, PGSIZE);  // not dirty, frozen or in A1
+  for(b = c->buf; b < c->buf+BPERCHUNK; b++){
+    initsleeplock(&b->lock, "buffer");
+    b->dev = NODEV;
+    b->refcnt = 0;
+    b->queue = BQ_AM;
+    b->next = bcache.free;
+    bcache.free = b;
+  }
+  c->next = bcache.chunks;
+  bcache.chunks = c;
+  bcache.nbuf += BPERCHUNK;
+  bcache.ngrow++;
+}
+
+// Find the cached buffer for the block in bk, whose lock
+// the caller holds, or return 0.
+static struct buf*
+lookup(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head; b; b = b->next)
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  return 0;
+}
+
+// Would the policy rather recycle a than b?
+static int
+before(struct buf *a, struct buf *b)
+{
+  int victim;
+
+  if(bcache.policy == BC_2Q && a->queue != b->queue){
+    victim = bcache.na1 > bcache.nbuf / 4 ? BQ_A1 : BQ_AM;
+    return a->queue == victim;
+  }
+  return a->lastuse < b->lastuse;
+}
+
+// Is the block one that A1 recycled recently? If so, forget
+// it, since it's coming back. Caller holds bcache.qlock.
+static int
+ghost(uint dev, uint blockno)
+{
+  int i;
+
+  for(i = 0; i < NGHOST; i++){
+    if(bcache.ghost[i].dev == dev && bcache.ghost[i].blockno == blockno){
+      bcache.ghost[i].dev = NODEV;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Take b's block out of the queue it is in, and if it is
+// in A1, remember it.
+static void
+dequeue(struct buf *b)
+{
+  if(b->queue != BQ_A1)
+    return;
+  acquire(&bcache.qlock);
+  b->queue = BQ_AM;
+  bcache.na1--;
+  bcache.ghost[bcache.ghostnext % NGHOST].dev = b->dev;
+  bcache.ghost[bcache.ghostnext % NGHOST].blockno = b->blockno;
+  bcache.ghostnext++;
+  release(&bcache.qlock);
+}
+
+// Note when b, whose bucket lock the caller holds, was last
+// used, for recycling; or under 2Q, first used, if in A1.
+// Each bucket keeps its buffers in that order, so evict()
+// need only look at the first unused ones.
+static void
+unused(struct buf *b)
+{
+  struct bucket *bk;
+  struct buf **pp, **tail;
+
+  if(b->queue == BQ_A1 && b->lastuse != 0 && bcache.policy == BC_2Q)
+    return;
+  b->lastuse = readtime();
+
+  // move b to the end of its bucket.
+  bk = bucket(b->dev, b->blockno);
+  tail = 0;
+  for(pp = &bk->head; *pp; ){
+    if(*pp == b){
+      *pp = b->next;
+      continue;
+    }
+    tail = pp = &(*pp)->next;
+  }
+  b->next = 0;
+  *(tail ? tail : &bk->head) = b;
+}
+
+// Take a buffer for reuse: one from the free list, or else
+// the unused buffer the policy picks, out of its bucket.
+// The caller holds bcache.lock and the lock of bk, which it
+// may look in too. Returns 0 if all are in use.
+static struct buf*
+evict(struct bucket *bk)
+{
+  struct bucket *k, *best = 0;
+  struct buf *b, **pp, **bestpp = 0;
+  int better, q, seen, all;
+
+  if((b = bcache.free) != 0){
+    bcache.free = b->next;
+    return b;
+  }
+
+  // keep the lock of the bucket with the best buffer so
+  // far, so no one can start using it. A bucket's best is the
+  // first unused buffer in it (see unused()), or under 2Q,
+  // the first of each queue.
+  all = bcache.policy == BC_2Q ? (1 << BQ_A1 | 1 << BQ_AM) : 1 << BQ_AM;
+  for(k = bcache.bucket; k < bcache.bucket+NBUCKET; k++){
+    if(k != bk)
+      acquire(&k->lock);
+    better = 0;
+    seen = 0;
+    for(pp = &k->head; (b = *pp) != 0 && seen != all; pp = &b->next){
+      q = bcache.policy == BC_2Q ? b->queue : BQ_AM;
+      if(b->refcnt != 0 || (seen & (1 << q)))
+        continue;
+      seen |= 1 << q;
+      if(bestpp == 0 || before(b, *bestpp)){
+        bestpp = pp;
+        better = 1;
+      }
+    }
+    if(better){
+      if(best && best != bk)
+        release(&best->lock);
+      best = k;
+    } else if(k != bk){
+      release(&k->lock);
+    }
   }
+  if(best == 0)
+    return 0;
+
+  b = *bestpp;
+  *bestpp = b->next;
+  if(best != bk)
+    release(&best->lock);
+  dequeue(b);
+  __sync_fetch_and_add(&bcache.nevict, 1);
+  return b;
+}
+
+// Take the first unused buffer out of bk, whose lock the
+// caller holds, if it is of the queue the policy recycles
+// from, so that recycling it needs no other bucket; or
+// return 0.
+static struct buf*
+recycle(struct bucket *bk)
+{
+  struct buf *b, **pp;
+  int q;
+
+  q = bcache.na1 > bcache.nbuf / 4 ? BQ_A1 : BQ_AM;
+  for(pp = &bk->head; (b = *pp) != 0; pp = &b->next){
+    if(b->refcnt != 0 || (bcache.policy == BC_2Q && b->queue != q))
+      continue;
+    *pp = b->next;
+    dequeue(b);
+    __sync_fetch_and_add(&bcache.nevict, 1);
+    return b;
+  }
+  return 0;
+}
+
+// Make b, which no one uses, hold the block in bk, whose
+// lock the caller holds, unread.
+static void
+claim(struct buf *b, struct bucket *bk, uint dev, uint blockno)
+{
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->ahead = 0;
+  b->frozen = 0;
+  b->refcnt = 1;
+  b->lastuse = 0;
+  b->queue = BQ_AM;
+  if(bcache.policy == BC_2Q){
+    acquire(&bcache.qlock);
+    if(!ghost(dev, blockno)){
+      b->queue = BQ_A1;
+      bcache.na1++;
+    }
+    release(&bcache.qlock);
+  }
+  b->next = bk->head;
+  bk->head = b;
+  __sync_fetch_and_add(&bcache.nmiss, 1);
 }
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
+// With ahead set, return 0 instead of a cached block or of
+// waiting for a buffer.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int ahead)
 {
+  struct bucket *bk = bucket(dev, blockno);
   struct buf *b;
+  void *page;
+  int grow, waiting;
 
-  acquire(&bcache.lock);
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  if((b = lookup(bk, dev, blockno)) != 0){
+    if(ahead){
+      release(&bk->lock);
+      return 0;
     }
+    b->refcnt++;
+    bk->nhit++;
+    release(&bk->lock);
+    trace(TE_BGET_HIT, dev, blockno);
+    acquiresleep(&b->lock);
+    return b;
   }
 
   // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
+  // Grow the cache rather than recycle, if it may, with no
+  // bcache lock held, or else recycle a buffer of this bucket.
+  grow = bcache.free == 0 && bcache.nbuf + BPERCHUNK <= bcache.maxbuf &&
+    kfreepages() > 2*KLOWPAGES;
+  if(bcache.free == 0 && !grow && (b = recycle(bk)) != 0){
+    claim(b, bk, dev, blockno);
+    release(&bk->lock);
+    trace(TE_BGET_MISS, dev, blockno);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bk->lock);
+  page = grow ? kalloc() : 0;
+
+  // Recycle the least recently used (LRU) unused buffer of
+  // any bucket. Check again once recycling is ours, since
+  // another hart may have brought the block in meanwhile.
+  acquire(&bcache.lock);
+  if(page)
+    addchunk(page);
+  waiting = 0;
+  for(;;){
+    acquire(&bk->lock);
+    if((b = lookup(bk, dev, blockno)) != 0 && !ahead){
+      b->refcnt++;
+      bk->nhit++;
+      if(waiting)
+        bcache.nwant--;
+      release(&bk->lock);
       release(&bcache.lock);
+      trace(TE_BGET_HIT, dev, blockno);
       acquiresleep(&b->lock);
       return b;
     }
+    if(b == 0 && (b = evict(bk)) != 0)
+      break;
+    release(&bk->lock);
+    if(ahead){
+      release(&bcache.lock);
+      return 0;
+    }
+
+    // Every buffer is in use, most likely pinned by the log.
+    // Look once more after saying we're waiting, so that
+    // letgo() can't miss us, then sleep until it wakes us,
+    // having the flusher checkpoint meanwhile.
+    if(bcache.nbuf < MINBUF && (page = kalloc()) != 0)
+      addchunk(page);
+    else if(!waiting){
+      bcache.nwant++;
+      waiting = 1;
+    } else {
+      logpressure();
+      sleep(&bcache.nwant, &bcache.lock);
+    }
+  }
+  if(waiting)
+    bcache.nwant--;
+  claim(b, bk, dev, blockno);
+  release(&bk->lock);
+  release(&bcache.lock);
+  trace(TE_BGET_MISS, dev, blockno);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Wake the bget()s waiting for a buffer, if any, now that one
+// is unused. Caller holds no bcache lock.
+static void
+letgo(void)
+{
+  if(__atomic_load_n(&bcache.nwant, __ATOMIC_SEQ_CST) == 0)
+    return;
+  // they sleep holding bcache.lock until they do.
+  acquire(&bcache.lock);
+  release(&bcache.lock);
+  wakeup(&bcache.nwant);
+}
+
+// Like bget(), but return 0 rather than read or recycle for a
+// block that isn't cached, and count nothing: for the log,
+// whose buffers of interest are pinned and so still cached.
+static struct buf*
+bcached(uint dev, uint blockno)
+{
+  struct bucket *bk = bucket(dev, blockno);
+  struct buf *b;
+
+  acquire(&bk->lock);
+  if((b = lookup(bk, dev, blockno)) != 0)
+    b->refcnt++;
+  release(&bk->lock);
+  if(b)
+    acquiresleep(&b->lock);
+  return b;
+}
+
+// Acquire the lock of the bucket b is in, b not being on the
+// free list, and return where in the bucket b is. recycle()
+// may be changing b's block without bcache.lock, in which
+// case return 0 with no lock held.
+static struct buf**
+lockbuf(struct buf *b, struct bucket **bkp)
+{
+  struct bucket *bk = bucket(b->dev, b->blockno);
+  struct buf **pp;
+
+  acquire(&bk->lock);
+  for(pp = &bk->head; *pp != 0 && *pp != b; pp = &(*pp)->next)
+    ;
+  if(*pp == 0){
+    release(&bk->lock);
+    return 0;
+  }
+  *bkp = bk;
+  return pp;
+}
+
+// Move b to the free list if no one is using it, and
+// return 1, or else return 0. Caller holds bcache.lock.
+static int
+drop(struct buf *b)
+{
+  struct bucket *bk;
+  struct buf **pp;
+
+  if(b->dev == NODEV)
+    return 1;
+  if((pp = lockbuf(b, &bk)) == 0)
+    return 0;
+  if(b->refcnt != 0){
+    release(&bk->lock);
+    return 0;
+  }
+  *pp = b->next;
+  release(&bk->lock);
+  dequeue(b);
+  b->dev = NODEV;
+  b->next = bcache.free;
+  bcache.free = b;
+  return 1;
+}
+
+// Is anyone using b? Caller holds bcache.lock.
+static int
+inuse(struct buf *b)
+{
+  struct bucket *bk;
+  int r;
+
+  if(b->dev == NODEV)
+    return 0;
+  if(lockbuf(b, &bk) == 0)
+    return 1;
+  r = b->refcnt != 0;
+  release(&bk->lock);
+  return r;
+}
+
+// Give up to n chunks of unused buffers back to kalloc(),
+// for when free memory runs low. Returns how many.
+int
+bshrink(int n)
+{
+  struct chunk *c, **cp, *freed = 0;
+  struct buf *b, **pp;
+  int i, idle, nfreed = 0;
+
+  if(bcache.chunks == 0)
+    return 0;
+
+  acquire(&bcache.lock);
+  for(cp = &bcache.chunks; (c = *cp) != 0 && nfreed < n; ){
+    // leave the cached blocks of a chunk that can't go.
+    idle = 1;
+    for(i = 0; i < BPERCHUNK && idle; i++)
+      if(inuse(&c->buf[i]))
+        idle = 0;
+    // a lookup may still have taken one meanwhile.
+    for(i = 0; i < BPERCHUNK && idle; i++)
+      if(!drop(&c->buf[i]))
+        idle = 0;
+    if(!idle){
+      cp = &c->next;
+      continue;
+    }
+    // all of c's buffers are on the free list now.
+    for(pp = &bcache.free; (b = *pp) != 0; ){
+      if(b >= c->buf && b < c->buf+BPERCHUNK)
+        *pp = b->next;
+      else
+        pp = &b->next;
+    }
+    *cp = c->next;
+    c->next = freed;
+    freed = c;
+    bcache.nbuf -= BPERCHUNK;
+    bcache.nshrink++;
+    nfreed++;
   }
-  panic("bget: no buffers");
+  release(&bcache.lock);
+
+  while((c = freed) != 0){
+    freed = c->next;
+    for(i = 0; i < BPERCHUNK; i++)
+      freelock(&c->buf[i].lock.lk);
+    kfree(c);
+  }
+  return nfreed;
+}
+
+// Set the replacement policy, unless policy is -1, and the
+// most buffers the cache may hold, unless maxbuf is -1, giving
+// back what it can of any excess. Returns 0, or -1 if either
+// is out of range.
+int
+bcctl(int policy, int maxbuf)
+{
+  int excess;
+
+  if((policy != -1 && policy != BC_LRU && policy != BC_2Q) ||
+     (maxbuf != -1 && maxbuf < MINBUF))
+    return -1;
+
+  acquire(&bcache.lock);
+  if(policy != -1)
+    bcache.policy = policy;
+  if(maxbuf != -1)
+    bcache.maxbuf = maxbuf;
+  excess = bcache.nbuf - bcache.maxbuf;
+  release(&bcache.lock);
+
+  if(excess > 0)
+    bshrink((excess + BPERCHUNK - 1) / BPERCHUNK);
+  return 0;
+}
+
+// Report the cache's size and hit counts.
+void
+bcstat(struct bcstat *st)
+{
+  struct bucket *bk;
+
+  memset(st, 0, sizeof(*st));
+  acquire(&bcache.lock);
+  st->nbuf = bcache.nbuf;
+  st->maxbuf = bcache.maxbuf;
+  st->policy = bcache.policy;
+  st->nmiss = bcache.nmiss;
+  st->nevict = bcache.nevict;
+  st->ngrow = bcache.ngrow;
+  st->nshrink = bcache.nshrink;
+  st->nahead = bcache.nahead;
+  st->nahit = bcache.nahit;
+  st->nreq = bcache.nreq;
+  st->nreqblk = bcache.nreqblk;
+  release(&bcache.lock);
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    st->nhit += bk->nhit;
+}
+
+// Read or write the n buffers in b, which hold consecutive
+// blocks, with one disk request, and wait for it.
+static void
+diskrw(struct buf **b, int n, int write)
+{
+  __sync_fetch_and_add(&bcache.nreq, 1);
+  __sync_fetch_and_add(&bcache.nreqblk, n);
+  virtio_disk_rwv(b, n, write);
+}
+
+// Start reading or writing the n buffers in b as one disk
+// request, which finishes with bdone() for each. The caller
+// holds them locked, and gives their locks to the disk.
+// If the disk's queue is full, do it now and return -1.
+static int
+diskstart(struct buf **b, int n, int write)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    disownsleep(&b[i]->lock);
+  __sync_fetch_and_add(&bcache.nreq, 1);
+  __sync_fetch_and_add(&bcache.nreqblk, n);
+  if(virtio_disk_start(b, n, write) == 0)
+    return 0;
+  virtio_disk_rwv(b, n, write);
+  for(i = 0; i < n; i++)
+    bdone(b[i]);
+  return -1;
+}
+
+// Set who may read b: pid, or anyone if 0. Waits for frozen
+// buffers sleep under bcache.frozenlock, not a bucket lock,
+// since kalloc()'s callers hold p->lock and bshrink() takes
+// bucket locks.
+static void
+setfrozen(struct buf *b, int pid)
+{
+  acquire(&bcache.frozenlock);
+  b->frozen = pid;
+  release(&bcache.frozenlock);
+  if(pid == 0)
+    wakeup(&b->frozen);
+}
+
+// Wait, with b unlocked, until the commit that froze b
+// installs it. Caller holds b locked, and does again after.
+static void
+waitfrozen(struct buf *b)
+{
+  releasesleep(&b->lock);
+  acquire(&bcache.frozenlock);
+  while(b->frozen)
+    sleep(&b->frozen, &bcache.frozenlock);
+  release(&bcache.frozenlock);
+  acquiresleep(&b->lock);
+}
+
+// Return locked bufs with the contents of the n blocks from
+// blockno on in b[0..n-1], reading each run of them that
+// isn't cached with one disk request. n is at most NBIOVEC.
+void
+bread_multi(uint dev, uint blockno, int n, struct buf **b)
+{
+  int i, j;
+
+  if(n < 1 || n > NBIOVEC)
+    panic("bread_multi");
+
+  for(i = 0; i < n; i++){
+    b[i] = bget(dev, blockno + i, 0);
+    if(b[i]->frozen && b[i]->frozen != myproc()->pid){
+      // the commit may be waiting to freeze one of those
+      // before it, so let them go and start again.
+      for(j = 0; j < i; j++)
+        brelse(b[j]);
+      waitfrozen(b[i]);
+      brelse(b[i]);
+      i = -1;
+      continue;
+    }
+    if(b[i]->dirty){
+      diskrw(&b[i], 1, 1);
+      b[i]->dirty = 0;
+      bunpin(b[i]);
+    }
+    if(b[i]->ahead){
+      b[i]->ahead = 0;
+      __sync_fetch_and_add(&bcache.nahit, 1);
+    }
+  }
+
+  for(i = 0; i < n; i = j){
+    for(j = i; j < n && !b[j]->valid; j++)
+      ;
+    if(j == i){
+      j++;
+      continue;
+    }
+    diskrw(&b[i], j - i, 0);
+    for(; i < j; i++)
+      b[i]->valid = 1;
+  }
+}
+
+// Return a locked buf for the indicated block, which the
+// caller will overwrite whole, without reading it.
+struct buf*
+bblank(uint dev, uint blockno)
+{
+  struct buf *b = bget(dev, blockno, 0);
+
+  if(b->dirty || b->frozen)
+    panic("bblank");
+  b->ahead = 0;
+  b->valid = 1;
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -94,60 +783,207 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
-  if(!b->valid) {
-    virtio_disk_rw(b, 0);
+  bread_multi(dev, blockno, 1, &b);
+  return b;
+}
+
+// Start reading the indicated block into the cache, unless
+// it is there already or no buffer is free. Returns -1 if
+// the disk's queue was full, so that it had to wait, else 0.
+int
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bget(dev, blockno, 1)) == 0)
+    return 0;
+  b->ahead = 1;
+  __sync_fetch_and_add(&bcache.nahead, 1);
+  return diskstart(&b, 1, 0);
+}
+
+// Freeze the indicated block, which the closing transaction
+// changed, until its commit installs it: from now on only the
+// calling process, which commits it, may read it.
+void
+bfreeze(uint dev, uint blockno)
+{
+  struct buf *b = bget(dev, blockno, 0);
+
+  setfrozen(b, myproc()->pid);
+  brelse(b);
+}
+
+// Install the indicated block, frozen until its transaction
+// committed: mark it for the flusher to write home with
+// bwriteback(), and let others at it. The log's pin stays
+// until it is written.
+void
+binstall(uint dev, uint blockno)
+{
+  struct buf *b = bget(dev, blockno, 0);
+
+  if(b->frozen != myproc()->pid)
+    panic("binstall");
+  b->dirty = 1;
+  setfrozen(b, 0);
+  brelse(b);
+}
+
+// Wait until the disk is done with the indicated block, if
+// bwriteback() or bwrite_async() left its buffer locked.
+void
+bwait(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bcached(dev, blockno)) != 0)
+    brelse(b);
+}
+
+// Start writing home those of the n blocks from blockno on
+// that are dirty, a run of them per disk request, without
+// waiting for the disk. n is at most NBIOVEC.
+void
+bwriteback(uint dev, uint blockno, int n)
+{
+  struct buf *b[NBIOVEC];
+  int i, nb = 0;
+
+  if(n < 1 || n > NBIOVEC)
+    panic("bwriteback");
+
+  for(i = 0; i < n; i++){
+    b[nb] = bcached(dev, blockno + i);
+    if(b[nb] && b[nb]->dirty){
+      nb++;
+      continue;
+    }
+    if(b[nb])
+      brelse(b[nb]);
+    if(nb > 0)
+      diskstart(b, nb, 1);
+    nb = 0;
+  }
+  if(nb > 0)
+    diskstart(b, nb, 1);
+}
+
+// Release b, whose read by breadahead() or write by
+// bwriteback() has finished. Called by the disk interrupt,
+// so b's lock belongs to no process.
+void
+bdone(struct buf *b)
+{
+  struct bucket *bk;
+  int unpin = 0, idle;
+
+  if(b->ahead)
     b->valid = 1;
+  if(b->dirty){
+    b->dirty = 0;
+    unpin = 1;     // the log's pin
   }
-  return b;
+  releasesleep(&b->lock);
+
+  bk = bucket(b->dev, b->blockno);
+  acquire(&bk->lock);
+  b->refcnt -= 1 + unpin;
+  idle = b->refcnt == 0;
+  if(idle)
+    unused(b);
+  release(&bk->lock);
+  if(idle)
+    letgo();
+}
+
+// Write the n buffers in b, which hold consecutive blocks,
+// to disk with one request. Must be locked.
+void
+bwrite_multi(struct buf **b, int n)
+{
+  int i;
+
+  if(n < 1 || n > NBIOVEC)
+    panic("bwrite_multi");
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&b[i]->lock) || b[i]->dev != b[0]->dev ||
+       b[i]->blockno != b[0]->blockno + i)
+      panic("bwrite_multi");
+  }
+  diskrw(b, n, 1);
+}
+
+// Start writing the n buffers in b, which hold consecutive
+// blocks, with one request, and release them without waiting:
+// the disk interrupt does, with bdone(). Must be locked. To
+// wait for the write, pin them first, and bwait() each.
+void
+bwrite_async(struct buf **b, int n)
+{
+  int i;
+
+  if(n < 1 || n > NBIOVEC)
+    panic("bwrite_async");
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&b[i]->lock) || b[i]->dev != b[0]->dev ||
+       b[i]->blockno != b[0]->blockno + i || b[i]->dirty)
+      panic("bwrite_async");
+  }
+  diskstart(b, n, 1);
 }
 
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
-  if(!holdingsleep(&b->lock))
-    panic("bwrite");
-  virtio_disk_rw(b, 1);
+  bwrite_multi(&b, 1);
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+  int idle;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  // b stays in its bucket while refcnt > 0.
+  bk = bucket(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
+  idle = b->refcnt == 0;
+  if (idle) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+    unused(b);
+  }
+  release(&bk->lock);
+  if (idle)
+    letgo();
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bucket(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bucket(b->dev, b->blockno);
+  int idle;
+
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  idle = b->refcnt == 0;
+  release(&bk->lock);
+  if(idle)
+    letgo();
 }
-
-
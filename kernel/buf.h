@@ -1,12 +1,16 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  int ahead;   // read ahead, and not yet read by bread()?
+  int dirty;   // installed by a commit, not yet written home?
+  int frozen;  // pid of the commit that alone may read it, or 0
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint64 lastuse;   // when refcnt last dropped to 0, for recycling
+  int queue;        // under 2Q, A1 or Am; see bio.c
+  struct buf *next; // next in its hash bucket
   uchar data[BSIZE];
 };
 
@@ -1,21 +1,40 @@
 struct buf;
+struct bcstat;
+struct diskstat;
 struct context;
 struct file;
 struct inode;
+struct logstat;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
+struct wtimer;
+struct uring;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bblank(uint, uint);
+void            bread_multi(uint, uint, int, struct buf**);
+int             breadahead(uint, uint);
+void            bdone(struct buf*);
+void            bfreeze(uint, uint);
+void            binstall(uint, uint);
+void            bwriteback(uint, uint, int);
+void            bwait(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwrite_multi(struct buf**, int);
+void            bwrite_async(struct buf**, int);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bshrink(int);
+void            bcstat(struct bcstat*);
+int             bcctl(int, int);
 
 // console.c
 void            consoleinit(void);
@@ -24,6 +43,7 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execimage(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -31,8 +51,10 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
+int             filereadat(struct file*, uint64, int n, int off);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filewriteat(struct file*, uint64, int n, int off);
 
 // fs.c
 void            fsinit(int);
@@ -54,21 +76,52 @@ void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
 
+// kprof.c
+void            kprofinit(void);
+void            kprofkernel(uint64, uint64);
+void            kprofuser(struct proc*);
+
+// sysfile.c
+struct file*    openfile(char*, int);
+int             fdallocproc(struct proc*, struct file*);
+
+// trace.c
+void            traceinit(void);
+void            trace(int, uint64, uint64);
+
+// uring.c
+uint64          uringsetup(int);
+int             uringenter(int, int);
+void            uringfree(struct proc*);
+
+// uprof.c
+void            uprofsample(struct proc*);
+int             uprof(int);
+int             uprofread(uint64, int);
+
 // ramdisk.c
 void            ramdiskinit(void);
 void            ramdiskintr(void);
 void            ramdiskrw(struct buf*);
 
+// ipi.c
+void            sendipi(int, int);
+void            ipiintr(void);
+
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+int             kfreepages(void);
+void            kreclaim(int);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+void            logstat(struct logstat*);
+void            logpressure(void);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
@@ -99,12 +152,35 @@ void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
+int             clone(uint64, uint64, uint64);
+int             join(int, uint64);
+void            reapthreads(struct proc*);
+int             kthread(void (*)(void*), void*, char*);
+int             kproc(void (*)(void*), void*, char*);
+struct proc*    spawnalloc(void);
+void            startchild(struct proc*);
+void            spawnfree(struct proc*);
+void            runqlen(int*);
+void            balance(void);
+int             setaffinity(int, uint64);
+int             getaffinity(int);
+int             getrusage(int, uint64);
+int             procinfo(uint64, int);
+void            tlbshootdown(pagetable_t);
+struct proc*    vmwalkbegin(pagetable_t);
+struct proc*    filesproc(struct proc*);
+struct inode*   cwdget(struct proc*);
+void            vmwalkend(struct proc*);
+int             waitpid(int, uint64, int);
 void            wakeup(void*);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
 
+// start.c
+int             timerfired(int);
+
 // swtch.S
 void            swtch(struct context*, struct context*);
 
@@ -112,6 +188,8 @@ void            swtch(struct context*, struct context*);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            freelock(struct spinlock*);
+void            lockstatinit(void);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
@@ -120,6 +198,7 @@ void            pop_off(void);
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+void            disownsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
 // string.c
@@ -138,6 +217,28 @@ int             argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+int             scstats(uint64, int);
+
+// timer.c
+void            timerqinit(void);
+void            timerqinithart(void);
+uint64          readtime(void);
+void            settimer(struct timer*, uint64, void (*)(struct timer*), void*);
+int             canceltimer(struct timer*);
+int             timerintr(void);
+void            tickstop(void);
+void            tickstart(void);
+int             nanosleep(uint64);
+
+// wheel.c
+void            wheelinit(void);
+void            wheellock(void);
+void            wheelunlock(void);
+uint64          wheelnow(void);
+void            wheeladd(struct wtimer*, uint64, void (*)(struct wtimer*), void*);
+int             wheeldel(struct wtimer*);
+void            wheeltick(void);
+int             sleepticks(int);
 
 // trap.c
 extern uint     ticks;
@@ -180,8 +281,10 @@ void            plic_complete(int);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_rwv(struct buf **, int, int);
+int             virtio_disk_start(struct buf **, int, int);
 void            virtio_disk_intr(void);
+void            virtio_disk_stat(struct diskstat*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
@@ -11,6 +12,21 @@ static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uin
 
 int
 exec(char *path, char **argv)
+{
+  struct proc *p = myproc();
+
+  // only the process itself can replace a shared address space.
+  if(p->group)
+    return -1;
+  return execimage(p, path, argv);
+}
+
+// Replace p's user memory with the program in path, and set
+// up its registers to start it with arguments argv. p is
+// the current process, or a new one from spawnalloc().
+// Returns argc, or -1 with p unchanged.
+int
+execimage(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
@@ -19,8 +35,8 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
 
+  kreclaim(0);
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -61,9 +77,6 @@ exec(char *path, char **argv)
   end_op();
   ip = 0;
 
-  p = myproc();
-  uint64 oldsz = p->sz;
-
   // Allocate two pages at the next page boundary.
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
@@ -109,9 +122,18 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  // Threads still running in the old one go away first.
+  if(p->nthread > 0)
+    reapthreads(p);
+  if(p->uring)
+    uringfree(p);
+  // only now can no sibling's sbrk() change it.
+  uint64 oldsz = p->sz;
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
   p->sz = sz;
+  if(sz > p->ru.maxsz)
+    p->ru.maxsz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
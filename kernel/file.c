@@ -11,6 +11,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
+#include "rusage.h"
 #include "proc.h"
 
 struct devsw devsw[NDEV];
@@ -105,6 +106,15 @@ filestat(struct file *f, uint64 addr)
 // addr is a user virtual address.
 int
 fileread(struct file *f, uint64 addr, int n)
+{
+  return filereadat(f, addr, n, -1);
+}
+
+// Read from file f at offset off, or at f->off, which is
+// then advanced, if off is -1. Pipes and devices ignore off.
+// addr is a user virtual address.
+int
+filereadat(struct file *f, uint64 addr, int n, int off)
 {
   int r = 0;
 
@@ -119,13 +129,17 @@ fileread(struct file *f, uint64 addr, int n)
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+    if(off >= 0)
+      r = readi(f->ip, 1, addr, off, n);
+    else if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
   } else {
     panic("fileread");
   }
 
+  if(r > 0)
+    myproc()->ru.rbytes += r;
   return r;
 }
 
@@ -133,6 +147,15 @@ fileread(struct file *f, uint64 addr, int n)
 // addr is a user virtual address.
 int
 filewrite(struct file *f, uint64 addr, int n)
+{
+  return filewriteat(f, addr, n, -1);
+}
+
+// Write to file f at offset off, or at f->off, which is
+// then advanced, if off is -1. Pipes and devices ignore off.
+// addr is a user virtual address.
+int
+filewriteat(struct file *f, uint64 addr, int n, int off)
 {
   int r, ret = 0;
 
@@ -161,7 +184,9 @@ filewrite(struct file *f, uint64 addr, int n)
 
       begin_op();
       ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
+      if(off >= 0)
+        r = writei(f->ip, 1, addr + i, off + i, n1);
+      else if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
         f->off += r;
       iunlock(f->ip);
       end_op();
@@ -177,6 +202,8 @@ filewrite(struct file *f, uint64 addr, int n)
     panic("filewrite");
   }
 
+  if(ret > 0)
+    myproc()->ru.wbytes += ret;
   return ret;
 }
 
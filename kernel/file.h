@@ -27,6 +27,10 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  uint ranext;        // block a sequential read would read next
+  uint rawin;         // read-ahead window, in blocks
+  uint raend;         // read ahead as far as here
 };
 
 // map major device number to device functions.
@@ -38,3 +42,6 @@ struct devsw {
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define KPROF   2
+#define KTRACE  3
+#define LOCKSTAT 4
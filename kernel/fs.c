@@ -15,6 +15,7 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
@@ -22,6 +23,11 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+
+// read-ahead window for sequential reads, in blocks.
+#define RAMIN 2
+#define RAMAX 16
+
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -267,6 +273,9 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->ranext = 0;
+  ip->rawin = 0;
+  ip->raend = 0;
   release(&icache.lock);
 
   return ip;
@@ -448,6 +457,51 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Note that blocks bn to bn+n-1 of ip, which is locked, are
+// about to be read. If they follow on from the blocks read
+// last, double the read-ahead window, up to RAMAX blocks, and
+// start reading the blocks it covers that haven't been started
+// already; after a jump anywhere else, halve the window and
+// start nothing.
+static void
+readahead(struct inode *ip, uint bn, uint n)
+{
+  uint b, end;
+
+  if(bn != ip->ranext && bn + 1 != ip->ranext){
+    ip->ranext = bn + n;
+    ip->rawin /= 2;
+    ip->raend = bn + n;
+    return;
+  }
+  if(bn + n == ip->ranext)  // the same block again
+    return;
+  ip->ranext = bn + n;
+  ip->rawin = ip->rawin ? min(2 * ip->rawin, RAMAX) : RAMIN;
+  end = min(bn + n + ip->rawin, (ip->size + BSIZE - 1) / BSIZE);
+  b = ip->raend > bn + n ? ip->raend : bn + n;
+  for(; b < end; b++)
+    if(breadahead(ip->dev, bmap(ip, b)) < 0)
+      break;
+  if(b > ip->raend)
+    ip->raend = b;
+}
+
+// Return how many of ip's blocks from bn on, up to n and
+// NBIOVEC, lie one after another on the disk, so that one
+// request can move them, and set *addr to the first's.
+static int
+contig(struct inode *ip, uint bn, uint n, uint *addr)
+{
+  int k;
+
+  *addr = bmap(ip, bn);
+  for(k = 1; k < n && k < NBIOVEC; k++)
+    if(bmap(ip, bn + k) != *addr + k)
+      break;
+  return k;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -455,22 +509,28 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
-  struct buf *bp;
+  uint tot, m, addr;
+  struct buf *bp[NBIOVEC];
+  int i, nb, bad;
 
   if(off > ip->size || off + n < off)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
 
-  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
-      brelse(bp);
-      break;
+  for(tot=0, bad=0; tot<n && !bad; ){
+    nb = contig(ip, off/BSIZE, (off%BSIZE + n - tot + BSIZE - 1) / BSIZE, &addr);
+    readahead(ip, off/BSIZE, nb);
+    bread_multi(ip->dev, addr, nb, bp);
+    for(i = 0; i < nb && !bad; i++){
+      m = min(n - tot, BSIZE - off%BSIZE);
+      if(either_copyout(user_dst, dst, bp[i]->data + (off % BSIZE), m) == -1)
+        bad = 1;
+      else
+        tot+=m, off+=m, dst+=m;
     }
-    brelse(bp);
+    for(i = 0; i < nb; i++)
+      brelse(bp[i]);
   }
   return tot;
 }
@@ -482,23 +542,29 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
-  uint tot, m;
-  struct buf *bp;
+  uint tot, m, addr;
+  struct buf *bp[NBIOVEC];
+  int i, nb, bad;
 
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
-  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
-      brelse(bp);
-      break;
+  for(tot=0, bad=0; tot<n && !bad; ){
+    nb = contig(ip, off/BSIZE, (off%BSIZE + n - tot + BSIZE - 1) / BSIZE, &addr);
+    bread_multi(ip->dev, addr, nb, bp);
+    for(i = 0; i < nb && !bad; i++){
+      m = min(n - tot, BSIZE - off%BSIZE);
+      if(either_copyin(bp[i]->data + (off % BSIZE), user_src, src, m) == -1)
+        bad = 1;
+      else {
+        log_write(bp[i]);
+        tot+=m, off+=m, src+=m;
+      }
     }
-    log_write(bp);
-    brelse(bp);
+    for(i = 0; i < nb; i++)
+      brelse(bp[i]);
   }
 
   if(n > 0){
@@ -630,7 +696,7 @@ namex(char *path, int nameiparent, char *name)
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
-    ip = idup(myproc()->cwd);
+    ip = cwdget(myproc());
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
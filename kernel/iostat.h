@@ -0,0 +1,32 @@
+// Storage statistics, from iostat(): the buffer cache's (see
+// bcstat.h, which must come first), the log's and the disk's,
+// since boot.
+// Both the kernel and user programs use this header file.
+
+#define NIOHIST 32   // buckets in the disk latency histogram
+
+struct logstat {
+  uint64 ncommit;   // transactions committed
+  uint64 nblk;      // blocks they logged
+  uint64 nabsorb;   // log_write()s of a block already logged
+  uint64 nwait;     // begin_op()s that had to wait
+  uint64 ncheckpoint; // checkpoints, which move the log's tail
+  uint64 nckblk;    // blocks they looked at writing home
+};
+
+struct diskstat {
+  uint64 nread;     // requests to read
+  uint64 nwrite;    // ... and to write
+  uint64 nblk;      // blocks they moved
+  int depth;        // requests in flight now
+  int maxdepth;     // ... at most
+  uint64 depthsum;  // requests in flight as each was made, summed
+  uint64 ns;        // total latency of finished requests
+  uint64 hist[NIOHIST]; // requests that took [2^i, 2^(i+1)) ns
+};
+
+struct iostat {
+  struct bcstat cache;
+  struct logstat log;
+  struct diskstat disk;
+};
@@ -0,0 +1,49 @@
+//
+// Inter-processor interrupts.
+//
+// A hart interrupts another by recording the reason in the
+// target's struct cpu and writing the target's CLINT MSIP
+// register. That raises a machine-mode software interrupt,
+// which timervec in kernelvec.S acknowledges and turns into
+// a supervisor software interrupt, and devintr() calls ipiintr().
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "defs.h"
+
+// Interrupt hart id for reason what (IPI_*).
+void
+sendipi(int id, int what)
+{
+  __sync_fetch_and_or(&cpus[id].ipi, what);
+  __sync_synchronize();
+  *(uint32*)CLINT_MSIP(id) = 1;
+}
+
+// Handle the IPIs pending for this hart.
+// Called from devintr() with interrupts off.
+void
+ipiintr(void)
+{
+  struct cpu *c = mycpu();
+
+  if(c->ipi & IPI_TLBFLUSH){
+    // taking this trap from user space already flushed the
+    // TLB in uservec, and userret flushes it again before user
+    // mappings are used. flush here too, then acknowledge.
+    sfence_vma();
+    __sync_fetch_and_and(&c->ipi, ~IPI_TLBFLUSH);
+  }
+
+  if(c->ipi & IPI_WAKE){
+    // kick() has already cleared c->idle; taking the
+    // interrupt got this CPU out of wfi in idle().
+    __sync_fetch_and_and(&c->ipi, ~IPI_WAKE);
+  }
+}
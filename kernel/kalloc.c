@@ -21,6 +21,7 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
+  int nfree;             // pages on freelist
 } kmem;
 
 void
@@ -59,9 +60,28 @@ kfree(void *pa)
   acquire(&kmem.lock);
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   release(&kmem.lock);
 }
 
+// take a page off the free list, or return 0.
+// *nfree is set to the number of pages left.
+static struct run*
+takepage(int *nfree)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  r = kmem.freelist;
+  if(r){
+    kmem.freelist = r->next;
+    kmem.nfree--;
+  }
+  *nfree = kmem.nfree;
+  release(&kmem.lock);
+  return r;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
@@ -69,14 +89,33 @@ void *
 kalloc(void)
 {
   struct run *r;
+  int nfree;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  r = takepage(&nfree);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// Take pages back from the block cache until there are
+// enough free for npages more, and KLOWPAGES to spare, if it
+// can. kalloc() can't, since its callers may hold any lock,
+// including ones bshrink() would need after them; so the
+// paths that allocate user memory call this first, holding
+// no locks.
+void
+kreclaim(int npages)
+{
+  int want = KLOWPAGES + npages - kfreepages();
+
+  if(want > 0)
+    bshrink(want);
+}
+
+// Number of free pages.
+int
+kfreepages(void)
+{
+  return kmem.nfree;
+}
@@ -0,0 +1,171 @@
+//
+// Sampling profiler.
+//
+// While enabled, each timer interrupt records where the CPU
+// was, with a short frame-pointer backtrace, into a ring for
+// that CPU. Reading the kprof device drains the rings as
+// struct ksamples; writing '1' to it starts sampling and '0'
+// stops it. user/kprof drives it, and kprof.py turns what it
+// prints into folded stacks for a flame graph.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "kprof.h"
+#include "defs.h"
+
+#define NSAMPLE 256  // per CPU
+
+struct ring {
+  struct spinlock lock;
+  uint head, tail;     // samples are at [tail, head)
+  uint dropped;        // samples lost because the ring was full
+  struct ksample s[NSAMPLE];
+};
+
+static struct {
+  int on;
+  struct ring ring[NCPU];
+} kprof;
+
+// start a sample in this CPU's ring, or return 0 if it is full.
+// on success, the caller holds the ring's lock.
+static struct ksample*
+newsample(void)
+{
+  struct ring *r = &kprof.ring[cpuid()];
+  struct ksample *s;
+  struct proc *p = myproc();
+
+  acquire(&r->lock);
+  if(r->head - r->tail == NSAMPLE){
+    r->dropped++;
+    release(&r->lock);
+    return 0;
+  }
+  s = &r->s[r->head % NSAMPLE];
+  s->hart = cpuid();
+  s->pid = p ? p->pid : 0;
+  if(p)
+    safestrcpy(s->name, p->name, sizeof(s->name));
+  else
+    s->name[0] = 0;
+  return s;
+}
+
+static void
+endsample(void)
+{
+  struct ring *r = &kprof.ring[cpuid()];
+
+  r->head++;
+  release(&r->lock);
+}
+
+// Called from kerneltrap() on a timer interrupt.
+// pc was interrupted, and fp is the frame pointer it was using.
+void
+kprofkernel(uint64 pc, uint64 fp)
+{
+  struct ksample *s;
+  uint64 stack = PGROUNDDOWN(r_sp());  // this kernel stack
+  int n;
+
+  if(!kprof.on || (s = newsample()) == 0)
+    return;
+  s->user = 0;
+  s->pc[0] = pc;
+  // the saved return address is at fp-8 and the caller's
+  // frame pointer at fp-16. stop at the end of the stack, or
+  // if pc wasn't using s0 as a frame pointer.
+  for(n = 1; n < KPROF_DEPTH && fp >= stack + 16 && fp <= stack + PGSIZE; n++){
+    s->pc[n] = *(uint64*)(fp - 8);
+    fp = *(uint64*)(fp - 16);
+  }
+  s->depth = n;
+  endsample();
+}
+
+// Called from usertrap() on a timer interrupt.
+void
+kprofuser(struct proc *p)
+{
+  struct ksample *s;
+  uint64 fp, frame[2];
+  int n;
+
+  if(!kprof.on || (s = newsample()) == 0)
+    return;
+  s->user = 1;
+  s->pc[0] = p->trapframe->epc;
+  // user programs are built with frame pointers too, but
+  // their frames have to be read with copyin().
+  fp = p->trapframe->s0;
+  for(n = 1; n < KPROF_DEPTH && fp != 0 && fp % 8 == 0; n++){
+    if(copyin(p->pagetable, (char*)frame, fp - 16, sizeof(frame)) < 0)
+      break;
+    s->pc[n] = frame[1];
+    fp = frame[0];
+  }
+  s->depth = n;
+  endsample();
+}
+
+// read as many whole samples as fit in n bytes.
+static int
+kprofread(int user_dst, uint64 dst, int n)
+{
+  struct ring *r;
+  struct ksample s;
+  int i, got = 0;
+
+  for(i = 0; i < NCPU; i++){
+    r = &kprof.ring[i];
+    acquire(&r->lock);
+    while(r->tail != r->head && n - got >= sizeof(s)){
+      s = r->s[r->tail % NSAMPLE];
+      r->tail++;
+      release(&r->lock);
+      if(either_copyout(user_dst, dst + got, &s, sizeof(s)) < 0)
+        return -1;
+      got += sizeof(s);
+      acquire(&r->lock);
+    }
+    release(&r->lock);
+  }
+  return got;
+}
+
+static int
+kprofwrite(int user_src, uint64 src, int n)
+{
+  char c;
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(either_copyin(&c, user_src, src + i, 1) < 0)
+      return -1;
+    if(c == '1')
+      kprof.on = 1;
+    else if(c == '0')
+      kprof.on = 0;
+  }
+  return n;
+}
+
+void
+kprofinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kprof.ring[i].lock, "kprof");
+  devsw[KPROF].read = kprofread;
+  devsw[KPROF].write = kprofwrite;
+}
@@ -0,0 +1,14 @@
+// Samples from the kernel profiler, read from the kprof
+// device; see kprof.c.
+// Both the kernel and user programs use this header file.
+
+#define KPROF_DEPTH  8    // pcs recorded per sample
+
+struct ksample {
+  int hart;
+  int pid;                 // interrupted process, or 0 if none
+  int user;                // 1 if pc[] are user addresses in process name
+  int depth;               // pc[] entries used
+  uint64 pc[KPROF_DEPTH];  // pc[0] was interrupted, the rest are return addresses
+  char name[16];           // process name, if pid != 0
+};
@@ -0,0 +1,13 @@
+// Spinlock statistics, read from the lockstat device;
+// see spinlock.c.
+// Both the kernel and user programs use this header file.
+
+struct lockstat {
+  char name[16];
+  uint64 nacquire;  // times acquired
+  uint64 ncontend;  // acquires that had to wait for another hart
+  uint64 nspin;     // times waiters polled the lock
+  uint64 maxhold;   // longest time held, in ns
+  uint64 nsleep;    // for sleeplocks: waits that slept
+  uint64 navoid;    // for sleeplocks: waits that ended while spinning
+};
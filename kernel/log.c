@@ -6,50 +6,120 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
+#include "bcstat.h"
+#include "iostat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
-// any reasoning required about whether a commit might
+// calls. The logging system only closes a transaction when
+// there are no FS system calls active in it. Thus there is
+// never any reasoning required about whether a commit might
 // write an uncommitted system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the last outstanding end_op() closes the
+// transaction.
 //
-// The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
-//   ...
-// Log appends are synchronous.
+// The next transaction runs while the last one commits. The
+// end_op() that closes a transaction freezes its blocks in the
+// buffer cache and lets new system calls in at once; then it
+// writes the closed transaction to the log, after the one
+// before it, and installs the blocks. A system call that reads
+// a frozen block waits for that; others don't wait at all.
+//
+// With system calls arriving from several processes, the last
+// end_op() waits up to GROUPNS for more to join its
+// transaction before it closes it, so that many small ones
+// share one commit.
+//
+// The log is a physical re-do log containing disk blocks,
+// kept as a circular journal. The on-disk log format:
+//   log super block, with where the oldest transaction
+//     that may not be home yet starts: the tail
+//   the journal, in which each transaction is
+//     header block, containing LOGMAGIC, a sequence number,
+//       a checksum and block #s for block A, B, C, ...
+//     block A
+//     block B
+//     block C
+//     ...
+//   wrapping around from its end to its start.
+// Log appends are synchronous: a commit starts writing all of
+// its log blocks, waits for them, and then writes the header.
+//
+// Writing the blocks to their home locations is not: a commit
+// leaves them dirty in the buffer cache, and committed
+// transactions stay in the journal until the flusher, a
+// kernel process, checkpoints them: writes home, in block
+// order, every block they left dirty, and then moves the tail
+// past them. It does that only when the journal is half full,
+// when a closing transaction finds no room, when the cache is
+// recycling buffers while dirty ones pin a good part of it, or
+// when bget() finds none to recycle. A transaction doesn't
+// close while that would leave more than LOGDIRTY blocks dirty
+// or committing, so that with the open one the log pins at
+// most LOGSIZE + LOGDIRTY buffers.
+// Recovery replays every transaction from the tail on whose
+// header has the next sequence number, in order, so long as
+// its blocks match the header's checksum.
+
+#define GROUPNS 200000  // 200us
+#define LOGMAGIC 0x21676f6c  // "log!", starting each header
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
+  uint magic;
   int n;
+  uint seq;
+  uint sum;   // checksum of seq, block[] and the blocks after it
   int block[LOGSIZE];
 };
 
+// Contents of the log super block.
+struct logsuper {
+  uint tail;  // journal position of the oldest transaction not home
+  uint seq;   // its sequence number
+};
+
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int size;        // blocks in the journal
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int closing;     // end_op() is closing the transaction, please wait.
+  int lingering;   // end_op() is waiting for others to join
+  int lingered;    // ... and has, for this transaction
+  int nop;         // FS sys calls in this transaction
+  int grouped;     // the last one had more than one
   int dev;
+  uint seq;        // this transaction's sequence number
+  uint written;    // the last transaction committed
+  // journal positions, counting blocks from when the log was
+  // made, so that they only grow.
+  uint head;       // where the next transaction to close goes
+  uint wpos;       // where the last one committed ends
+  uint tail;       // as in the log super block
+  int waitspace;   // a closing transaction needs the tail moved
+  int pressure;    // bget() found every buffer in use
+  int nclosing;    // blocks of closed transactions not yet committed
+  int nck;         // blocks the committed transactions left dirty
+  int nckflush;    // blocks the flusher is writing home
+  int ckblock[LOGBLOCKS];
+  uint64 lastevict; // the cache's nevict when the flusher last looked
   struct logheader lh;
+  struct logstat st;
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void flusher(void*);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -59,82 +129,215 @@ initlog(int dev, struct superblock *sb)
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
-  log.size = sb->nlog;
+  log.size = sb->nlog - 1;
+  if (log.size < 2*(LOGSIZE+1) || log.size > LOGBLOCKS)
+    panic("initlog: log size");
   log.dev = dev;
   recover_from_log();
+  if(kproc(flusher, 0, "flusher") < 0)
+    panic("initlog: flusher");
+}
+
+// The disk block at journal position pos.
+static int
+logblock(uint pos)
+{
+  return log.start + 1 + pos % log.size;
 }
 
-// Copy committed blocks from log to their home location
+// How many of the n blocks from journal position pos on lie
+// before the journal wraps around, up to NBIOVEC, for one
+// disk request.
+static int
+logrun(uint pos, int n)
+{
+  int left = log.size - pos % log.size;
+
+  if (n > left)
+    n = left;
+  if (n > NBIOVEC)
+    n = NBIOVEC;
+  return n;
+}
+
+// Fold the n words at p into sum (32-bit FNV-1a, a word at
+// a time).
+static uint
+cksum(uint sum, void *p, int n)
+{
+  uint *w = p;
+
+  while (n-- > 0)
+    sum = (sum ^ *w++) * 16777619;
+  return sum;
+}
+
+// The checksum of lh's header fields, to go on with its
+// blocks' data.
+static uint
+headsum(struct logheader *lh)
+{
+  return cksum(cksum(2166136261U, &lh->seq, 1), lh->block, lh->n);
+}
+
+// Whether the log blocks of the transaction lh, which starts
+// at journal position pos, are the ones its header's sum was
+// taken over, rather than torn or left from an earlier lap.
+static int
+check_trans(struct logheader *lh, uint pos)
+{
+  struct buf *buf;
+  uint sum = headsum(lh);
+  int i;
+
+  for (i = 0; i < lh->n; i++)
+    breadahead(log.dev, logblock(pos+1+i));
+  for (i = 0; i < lh->n; i++) {
+    buf = bread(log.dev, logblock(pos+1+i));
+    sum = cksum(sum, buf->data, BSIZE / sizeof(uint));
+    brelse(buf);
+  }
+  return sum == lh->sum;
+}
+
+// Copy committed blocks from the log to their home
+// location on disk, for recovery of the transaction lh, which
+// starts at journal position pos. The log blocks are all read
+// ahead first; blocks whose homes follow on from each other
+// are written together, and all the writes are in flight at
+// once.
 static void
-install_trans(void)
+install_trans(struct logheader *lh, uint pos)
 {
-  int tail;
+  struct buf *lbuf[NBIOVEC], *dbuf[LOGSIZE];
+  int tail, n, i;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+  for (i = 0; i < lh->n; i++)
+    breadahead(log.dev, logblock(pos+1+i));
+  for (tail = 0; tail < lh->n; tail += n) {
+    for (n = 1; n < logrun(pos+1+tail, lh->n - tail) &&
+         lh->block[tail+n] == lh->block[tail] + n; n++)
+      ;
+    bread_multi(log.dev, logblock(pos+1+tail), n, lbuf); // read log blocks
+    for (i = 0; i < n; i++) {
+      dbuf[tail+i] = bblank(log.dev, lh->block[tail+i]); // dsts, unread
+      memmove(dbuf[tail+i]->data, lbuf[i]->data, BSIZE);  // copy block to dst
+      bpin(dbuf[tail+i]);
+      brelse(lbuf[i]);
+    }
+    bwrite_async(&dbuf[tail], n);  // write dsts to disk
+  }
+  for (i = 0; i < lh->n; i++) {
+    bwait(log.dev, lh->block[i]);
+    bunpin(dbuf[i]);
   }
 }
 
-// Read the log header from disk into the in-memory log header
+// Read the transaction header at block blockno from disk
+// into lh.
 static void
-read_head(void)
+read_head(int blockno, struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
+  struct buf *buf = bread(log.dev, blockno);
+  struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  lh->n = hb->n;
+  lh->seq = hb->seq;
+  lh->sum = hb->sum;
+  if (hb->magic != LOGMAGIC || lh->n < 0 || lh->n > LOGSIZE)
+    lh->n = 0;  // not a header
+  for (i = 0; i < lh->n; i++) {
+    lh->block[i] = hb->block[i];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Write a transaction header to disk, at block blockno.
+// Writing a transaction's header is the true point at
+// which it commits.
 static void
-write_head(void)
+write_head(int blockno, struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
+  struct buf *buf = bblank(log.dev, blockno);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  memset(buf->data, 0, BSIZE);
+  hb->magic = LOGMAGIC;
+  hb->n = lh->n;
+  hb->seq = lh->seq;
+  hb->sum = lh->sum;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
   bwrite(buf);
   brelse(buf);
 }
 
+// Write the log super block: every transaction before seq,
+// which starts at journal position tail, is home.
+static void
+write_super(uint tail, uint seq)
+{
+  struct buf *buf = bblank(log.dev, log.start);
+  struct logsuper *ls = (struct logsuper *) (buf->data);
+
+  memset(buf->data, 0, BSIZE);
+  ls->tail = tail;
+  ls->seq = seq;
+  bwrite(buf);
+  brelse(buf);
+}
+
+// Replay the committed transactions from the tail on, in
+// order, and move the tail past them.
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(); // if committed, copy from log to disk
+  struct buf *buf = bread(log.dev, log.start);
+  struct logsuper ls = *(struct logsuper *) (buf->data);
+  struct logheader *lh = &log.lh;
+  uint pos = ls.tail, seq = ls.seq;
+
+  // keep it cached for good, so that the flusher never waits
+  // in bget() for a buffer to write it with.
+  bpin(buf);
+  brelse(buf);
+  for (;;) {
+    read_head(logblock(pos), lh);
+    if (lh->n == 0 || lh->seq != seq || !check_trans(lh, pos))
+      break;  // not committed, torn, or left from an earlier lap
+    install_trans(lh, pos); // copy from log to disk
+    pos += 1 + lh->n;
+    seq++;
+  }
+  log.head = log.wpos = log.tail = pos;
+  log.seq = seq;
+  log.written = seq - 1;
   log.lh.n = 0;
-  write_head(); // clear the log
+  write_super(pos, seq); // clear the log
 }
 
 // called at the start of each FS system call.
 void
 begin_op(void)
 {
+  int waited = 0;
+
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.closing){
+      waited = 1;
       sleep(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
       // this op might exhaust log space; wait for commit.
+      waited = 1;
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.nop += 1;
+      log.st.nwait += waited;
       release(&log.lock);
+      trace(TE_BEGIN_OP, 0, 0);
       break;
     }
   }
@@ -147,13 +350,26 @@ end_op(void)
 {
   int do_commit = 0;
 
+  trace(TE_END_OP, 0, 0);
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
+  if(log.closing)
+    panic("log.closing");
+  if(log.outstanding == 0 && log.lh.n > 0 && !log.lingering &&
+     !log.lingered && log.grouped &&
+     log.lh.n + MAXOPBLOCKS <= LOGSIZE){
+    // others have been committing along with us; give
+    // them a moment to join this transaction. If they do,
+    // the last of them to finish closes it.
+    log.lingering = log.lingered = 1;
+    release(&log.lock);
+    nanosleep(GROUPNS);
+    acquire(&log.lock);
+    log.lingering = 0;
+  }
+  if(log.outstanding == 0 && log.lh.n > 0 && !log.lingering){
     do_commit = 1;
-    log.committing = 1;
+    log.closing = 1;
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
@@ -166,38 +382,188 @@ end_op(void)
     // call commit w/o holding locks, since not allowed
     // to sleep with locks.
     commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy modified blocks from cache to the journal from
+// position pos on, without reading the log blocks first, and
+// write them up to NBIOVEC blocks per disk request, all the
+// requests in flight at once. Sets lh's checksum.
 static void
-write_log(void)
+write_log(struct logheader *lh, uint pos)
 {
-  int tail;
+  struct buf *to[LOGSIZE];
+  int tail, n, i;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  lh->sum = headsum(lh);
+  for (tail = 0; tail < lh->n; tail += n) {
+    n = logrun(pos+1+tail, lh->n - tail);
+    for (i = tail; i < tail + n; i++) {
+      struct buf *from = bread(log.dev, lh->block[i]); // cache block
+      to[i] = bblank(log.dev, logblock(pos+1+i)); // log block
+      memmove(to[i]->data, from->data, BSIZE);
+      lh->sum = cksum(lh->sum, to[i]->data, BSIZE / sizeof(uint));
+      brelse(from);
+      bpin(to[i]);  // so that it stays to wait for
+    }
+    bwrite_async(&to[tail], n);  // write the log
+  }
+  for (i = 0; i < lh->n; i++) {
+    bwait(log.dev, logblock(pos+1+i));
+    bunpin(to[i]);
   }
 }
 
+// Note that the committed block blockno is dirty, for the
+// next checkpoint. Caller holds log.lock.
+static void
+checkpointlater(int blockno)
+{
+  int i;
+
+  for (i = 0; i < log.nck; i++)
+    if (log.ckblock[i] == blockno)
+      return;
+  if (log.nck >= LOGBLOCKS)
+    panic("checkpointlater");
+  log.ckblock[log.nck++] = blockno;
+}
+
+// Close the transaction, which end_op() has stopped new
+// system calls joining, and commit it once the one before
+// it has.
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  struct logheader lh;
+  uint seq, pos;
+  int i;
+
+  // no system call is active, so none can be changing
+  // the blocks, and none can join until closing is clear.
+  acquire(&log.lock);
+  seq = log.seq;
+  while(log.head + 1 + log.lh.n - log.tail > log.size ||
+        log.nclosing + log.nck + log.nckflush + log.lh.n > LOGDIRTY){
+    // no room in the journal, or for more dirty buffers,
+    // until the flusher checkpoints.
+    log.waitspace = 1;
+    wakeup(&log.written);
+    sleep(&log.tail, &log.lock);
+  }
+  pos = log.head;
+  log.head += 1 + log.lh.n;
+  log.nclosing += log.lh.n;
+  release(&log.lock);
+
+  lh = log.lh;
+  lh.seq = seq;
+  for (i = 0; i < lh.n; i++)
+    bfreeze(log.dev, lh.block[i]);
+  trace(TE_COMMIT, lh.n, 0);
+
+  acquire(&log.lock);
+  log.lh.n = 0;
+  log.seq++;
+  log.grouped = log.nop > 1;
+  log.nop = 0;
+  log.lingered = 0;
+  log.closing = 0;
+  wakeup(&log);
+  while(log.written != seq - 1)  // commit in order
+    sleep(&log.written, &log.lock);
+  release(&log.lock);
+
+  write_log(&lh, pos);  // Write modified blocks from cache to log
+  write_head(logblock(pos), &lh); // Write header to disk -- the real commit
+  for (i = 0; i < lh.n; i++)
+    binstall(log.dev, lh.block[i]); // dirty, until checkpointed
+
+  acquire(&log.lock);
+  for (i = 0; i < lh.n; i++)
+    checkpointlater(lh.block[i]);
+  log.nclosing -= lh.n;
+  log.st.ncommit++;
+  log.st.nblk += lh.n;
+  log.written = seq;
+  log.wpos = pos + 1 + lh.n;
+  wakeup(&log.written);
+  wakeup(&log.tail);  // for a transaction waiting on nclosing
+  release(&log.lock);
+  trace(TE_COMMITTED, 0, 0);
+}
+
+// Whether the flusher should checkpoint now, with st the
+// cache's counts. Caller holds log.lock.
+static int
+needcheckpoint(struct bcstat *st)
+{
+  int recycling = st->nevict != log.lastevict;
+
+  log.lastevict = st->nevict;
+  if (log.nck == 0)
+    return 0;
+  return log.waitspace || log.pressure ||
+    (log.wpos - log.tail) * 2 > log.size ||
+    (recycling && log.nck * 4 > st->maxbuf);
+}
+
+// The flusher: checkpoint the committed transactions when
+// needcheckpoint() says so, writing home the blocks they left
+// dirty and then moving the tail past them.
+static void
+flusher(void *arg)
+{
+  static int block[LOGBLOCKS];
+  struct bcstat st;
+  int i, j, n, blockno;
+  uint tail, seq;
+
+  for(;;){
+    bcstat(&st);
+    acquire(&log.lock);
+    if(!needcheckpoint(&st)){
+      sleep(&log.written, &log.lock);
+      release(&log.lock);
+      continue;
+    }
+    n = log.nck;
+    for(i = 0; i < n; i++)
+      block[i] = log.ckblock[i];
+    log.nck = 0;
+    log.nckflush = n;
+    log.pressure = 0;
+    tail = log.wpos;
+    seq = log.written + 1;
+    release(&log.lock);
+
+    // in block order, so the disk sees one sorted batch, and
+    // runs of blocks go in one request each. Blocks that were
+    // written since, by bread(), aren't dirty any more.
+    for(i = 1; i < n; i++){
+      blockno = block[i];
+      for(j = i; j > 0 && block[j-1] > blockno; j--)
+        block[j] = block[j-1];
+      block[j] = blockno;
+    }
+    for(i = 0; i < n; i = j){
+      for(j = i + 1; j < n && j - i < NBIOVEC &&
+          block[j] == block[i] + (j - i); j++)
+        ;
+      bwriteback(log.dev, block[i], j - i);
+    }
+    for(i = 0; i < n; i++)
+      bwait(log.dev, block[i]);
+    write_super(tail, seq);
+
+    acquire(&log.lock);
+    log.tail = tail;
+    log.nckflush = 0;
+    log.waitspace = 0;
+    log.st.ncheckpoint++;
+    log.st.nckblk += n;
+    wakeup(&log.tail);
+    release(&log.lock);
   }
 }
 
@@ -215,7 +581,7 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= LOGSIZE)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -229,7 +595,29 @@ log_write(struct buf *b)
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
     log.lh.n++;
+  } else {
+    log.st.nabsorb++;
   }
   release(&log.lock);
 }
 
+// bget() found every buffer in use: have the flusher
+// checkpoint, which lets go of the dirty ones.
+void
+logpressure(void)
+{
+  acquire(&log.lock);
+  log.pressure = 1;
+  wakeup(&log.written);
+  release(&log.lock);
+}
+
+// Report the log's counts.
+void
+logstat(struct logstat *st)
+{
+  acquire(&log.lock);
+  *st = log.st;
+  release(&log.lock);
+}
+
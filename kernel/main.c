@@ -22,11 +22,17 @@ main()
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
+    timerqinit();    // per-CPU timer queues
+    wheelinit();     // timer wheel for sleep()
+    timerqinithart(); // start the scheduler tick
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode cache
     fileinit();      // file table
+    kprofinit();     // profiler device
+    traceinit();     // trace device
+    lockstatinit();  // lock statistics device
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -38,6 +44,7 @@ main()
     printf("hart %d starting\n", cpuid());
     kvminithart();    // turn on paging
     trapinithart();   // install kernel trap vector
+    timerqinithart(); // start the scheduler tick
     plicinithart();   // ask PLIC for device interrupts
   }
 
@@ -27,8 +27,10 @@
 
 // local interrupt controller, which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid)) // software interrupt pending.
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define CLINT_FREQ 10000000L          // CLINT_MTIME cycles per second in qemu.
 
 // qemu puts programmable interrupt controller here.
 #define PLIC 0x0c000000L
@@ -62,6 +64,16 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   URING (the process's uring buffer, if any)
+//   THREADFRAME(p) for each thread sharing the page table
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// threads created by clone() share their process's page table,
+// so each maps its own trapframe beneath TRAPFRAME, indexed by
+// the thread's slot in proc[].
+#define THREADFRAME(p) (TRAPFRAME - ((p)+1)*PGSIZE)
+
+// the rings shared with the kernel by uring_setup().
+#define URING (THREADFRAME(NPROC))
@@ -7,7 +7,15 @@
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in a transaction
+#define LOGBLOCKS    (4*(LOGSIZE+1))  // blocks in the circular log
+#define LOGDIRTY     (2*LOGSIZE)      // most blocks committed transactions leave dirty
+#define NBUF         (MAXOPBLOCKS*3)  // disk block cache buffers that are always there
+#define MINBUF       (NBUF+2*LOGSIZE+LOGDIRTY)  // least the block cache may be limited to
+#define BCACHEFRAC   8     // the block cache grows to at most 1/BCACHEFRAC of free RAM
+#define KLOWPAGES    64    // kreclaim() shrinks the block cache to keep this many pages free
+#define NBIOVEC      4     // most blocks in one disk request
+#define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define TICKHZ       10    // scheduler ticks per second
+#define BALANCETICKS TICKHZ  // ticks between run-queue load balancing
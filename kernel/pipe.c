@@ -3,6 +3,7 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
@@ -68,6 +69,7 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    freelock(&pi->lock);
     kfree((char*)pi);
   } else
     release(&pi->lock);
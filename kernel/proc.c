@@ -3,8 +3,11 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
+#include "wait.h"
+#include "trace.h"
 
 struct cpu cpus[NCPU];
 
@@ -15,9 +18,23 @@ struct proc *initproc;
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// helps ensure that wakeups of wait()ing
+// parents are not lost. protects p->parent,
+// p->children and p->sibling.
+// must be acquired before any p->lock.
+struct spinlock wait_lock;
+
+static void kthreadstart(void);
 extern void forkret(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static int growgroup(struct proc *g, int n);
+static void idle(struct cpu *c);
+static void kick(struct proc *p);
+static void run(struct cpu *c, struct proc *p);
+static struct proc *steal(int id);
+static void migrate(struct proc *p, int id);
+static void dupfiles(struct proc *p, struct proc *np);
 
 extern char trampoline[]; // trampoline.S
 
@@ -28,8 +45,10 @@ procinit(void)
   struct proc *p;
   
   initlock(&pid_lock, "nextpid");
+  initlock(&wait_lock, "wait_lock");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
+      initlock(&p->filelock, "proc.files");
 
       // Allocate a page for the process's kernel stack.
       // Map it high in memory, followed by an invalid
@@ -106,9 +125,11 @@ allocproc(void)
 
 found:
   p->pid = allocpid();
+  p->state = USED;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+    freeproc(p);
     release(&p->lock);
     return 0;
   }
@@ -121,6 +142,12 @@ found:
     return 0;
   }
 
+  p->trapframeva = TRAPFRAME;
+  p->affinity = ALLCPUS;
+  p->cpu = 0;
+  memset(&p->ru, 0, sizeof(p->ru));
+  memset(&p->cru, 0, sizeof(p->cru));
+
   // Set up new context to start executing at forkret,
   // which returns to user space.
   memset(&p->context, 0, sizeof(p->context));
@@ -139,12 +166,33 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
+  if(p->group){
+    // a thread: the page table belongs to the group.
+    // caller holds wait_lock, which serializes this with clone().
+    uvmunmap(p->pagetable, p->trapframeva, 1, 0);
+    p->group->nthread--;
+  } else if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
+  p->trapframeva = 0;
+  p->ustack = 0;
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
+  p->children = 0;
+  p->sibling = 0;
+  p->group = 0;
+  p->nthread = 0;
+  if(p->prof)
+    kfree((void*)p->prof);
+  p->prof = 0;
+  p->profticks = 0;
+  p->proftick = 0;
+  p->profchildren = 0;
+  p->stracemask = 0;
+  p->kthread = 0;
+  p->uring = 0;
+  p->vmbusy = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
@@ -241,6 +289,13 @@ growproc(int n)
   uint sz;
   struct proc *p = myproc();
 
+  if(n > 0)
+    kreclaim(PGROUNDUP(n) / PGSIZE);
+  if(p->group)
+    return growgroup(p->group, n);
+  if(p->nthread)
+    return growgroup(p, n);
+
   sz = p->sz;
   if(n > 0){
     if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
@@ -250,20 +305,123 @@ growproc(int n)
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
   p->sz = sz;
+  if(sz > p->ru.maxsz)
+    p->ru.maxsz = sz;
   return 0;
 }
 
+// Keep others from resizing g's address space, which its
+// threads share, until vmunlock(). May sleep.
+static void
+vmlock(struct proc *g)
+{
+  acquire(&g->lock);
+  while(g->vmbusy)
+    sleep(&g->vmbusy, &g->lock);
+  g->vmbusy = 1;
+  release(&g->lock);
+}
+
+static void
+vmunlock(struct proc *g)
+{
+  acquire(&g->lock);
+  g->vmbusy = 0;
+  release(&g->lock);
+  wakeup(&g->vmbusy);
+}
+
+// copyin() and copyout() walk the page table in software, and
+// may be using a page's physical address after a shrinking
+// sibling has revoked it; they can't sleep for vmlock(), as
+// callers may hold spinlocks, so they count themselves in
+// the address space's owner instead. Returns the owner, for
+// vmwalkend(), or 0 if pagetable isn't the caller's.
+struct proc*
+vmwalkbegin(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+  struct proc *g;
+
+  if(p == 0)
+    return 0;
+  g = p->group ? p->group : p;
+  if(g->pagetable != pagetable)
+    return 0;
+  __sync_fetch_and_add(&g->vmwalk, 1);
+  return g;
+}
+
+void
+vmwalkend(struct proc *g)
+{
+  if(g)
+    __sync_fetch_and_sub(&g->vmwalk, 1);
+}
+
+// growproc() for an address space shared by threads.
+// Every thread must see the new size, and memory given back
+// can't be freed while another hart may still reach it
+// through a stale TLB entry, or while a sibling's copyin()
+// or copyout() may have looked it up before it was revoked.
+static int
+growgroup(struct proc *g, int n)
+{
+  struct proc *t;
+  uint64 a, sz, newsz;
+  int r = 0;
+
+  vmlock(g);
+  sz = newsz = g->sz;
+  if(n > 0){
+    if((newsz = uvmalloc(g->pagetable, sz, sz + n)) == 0){
+      newsz = sz;
+      r = -1;
+    }
+  } else if(n < 0 && sz + n < sz){
+    newsz = sz + n;
+    // revoke user access first, then make sure no other hart
+    // still has the old mappings cached, and no kernel copy
+    // that found them before is still going, and only then
+    // free. copies that start after this fail on them.
+    for(a = PGROUNDUP(newsz); a < PGROUNDUP(sz); a += PGSIZE)
+      uvmclear(g->pagetable, a);
+    tlbshootdown(g->pagetable);
+    while(__atomic_load_n(&g->vmwalk, __ATOMIC_SEQ_CST) != 0)
+      yield();
+    newsz = uvmdealloc(g->pagetable, sz, newsz);
+  }
+
+  acquire(&wait_lock);
+  g->sz = newsz;
+  for(t = g->children; t; t = t->sibling)
+    if(t->group == g)
+      t->sz = newsz;
+  release(&wait_lock);
+  vmunlock(g);
+
+  return r;
+}
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int
 fork(void)
 {
-  int i, pid;
-  struct proc *np;
+  int pid;
+  struct proc *np, *g;
   struct proc *p = myproc();
 
+  kreclaim(PGROUNDUP(p->sz) / PGSIZE);
+
+  // no sibling thread may resize the address space until
+  // it is copied. vmlock() sleeps, so before allocproc().
+  g = p->group ? p->group : p;
+  vmlock(g);
+
   // Allocate process.
   if((np = allocproc()) == 0){
+    vmunlock(g);
     return -1;
   }
 
@@ -271,11 +429,11 @@ fork(void)
   if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
     freeproc(np);
     release(&np->lock);
+    vmunlock(g);
     return -1;
   }
   np->sz = p->sz;
-
-  np->parent = p;
+  np->ru.maxsz = np->sz;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -284,46 +442,429 @@ fork(void)
   np->trapframe->a0 = 0;
 
   // increment reference counts on open file descriptors.
-  for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+  dupfiles(p, np);
+
+  // start on the parent's hart; balance() or an idle
+  // hart may move it.
+  np->affinity = p->affinity;
+  np->cpu = p->cpu;
+  np->profticks = p->profchildren;
+  np->stracemask = p->stracemask;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
 
+  release(&np->lock);
+  vmunlock(g);
+
+  startchild(np);
+
+  return pid;
+}
+
+// The process whose open files and current directory p
+// uses: its group, if p is a thread from clone(). A kthread()
+// keeps its own.
+struct proc*
+filesproc(struct proc *p)
+{
+  return p->group && !p->kthread ? p->group : p;
+}
+
+// A reference to p's current directory, which a sibling
+// thread's chdir() may be replacing.
+struct inode*
+cwdget(struct proc *p)
+{
+  struct proc *fp = filesproc(p);
+  struct inode *ip;
+
+  acquire(&fp->filelock);
+  ip = idup(fp->cwd);
+  release(&fp->filelock);
+  return ip;
+}
+
+// Give np references to p's open files and current
+// directory, for fork() and spawn().
+static void
+dupfiles(struct proc *p, struct proc *np)
+{
+  struct proc *fp = filesproc(p);
+  int i;
+
+  acquire(&fp->filelock);
+  for(i = 0; i < NOFILE; i++)
+    if(fp->ofile[i])
+      np->ofile[i] = filedup(fp->ofile[i]);
+  np->cwd = idup(fp->cwd);
+  release(&fp->filelock);
+}
+
+// Make np, which allocproc() returned and which is set up
+// to run, a child of the current process, and let it run.
+void
+startchild(struct proc *np)
+{
+  struct proc *p = myproc();
+
+  acquire(&wait_lock);
+  np->parent = p;
+  np->sibling = p->children;
+  p->children = np;
+  release(&wait_lock);
+
+  acquire(&np->lock);
   np->state = RUNNABLE;
+  release(&np->lock);
+  kick(np);
+}
 
+// First half of spawn(): allocate a process that shares
+// nothing with the current one but its open files, cwd and
+// CPU affinity, and has no memory yet. Its registers are zero.
+// The caller loads a program into it with execimage(), then
+// calls startchild(), or spawnfree() on failure.
+struct proc*
+spawnalloc(void)
+{
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0)
+    return 0;
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  dupfiles(p, np);
+  np->affinity = p->affinity;
+  np->cpu = p->cpu;
+  np->profticks = p->profchildren;
+  np->stracemask = p->stracemask;
   release(&np->lock);
+  return np;
+}
 
-  return pid;
+// Undo spawnalloc().
+void
+spawnfree(struct proc *np)
+{
+  int fd;
+
+  for(fd = 0; fd < NOFILE; fd++){
+    if(np->ofile[fd]){
+      fileclose(np->ofile[fd]);
+      np->ofile[fd] = 0;
+    }
+  }
+  begin_op();
+  iput(np->cwd);
+  end_op();
+  np->cwd = 0;
+
+  acquire(&np->lock);
+  freeproc(np);
+  release(&np->lock);
+}
+
+// Allocate a thread in g's address space, and make it one of
+// g's children; a kernel thread if kernel is set.
+// Returns it with p->lock not held, or 0.
+static struct proc*
+allocthread(struct proc *g, int kernel)
+{
+  struct proc *np;
+
+  // Allocate process.
+  if((np = allocproc()) == 0){
+    return 0;
+  }
+
+  // threads use the group's page table instead of the
+  // private one allocproc() made.
+  proc_freepagetable(np->pagetable, 0);
+  np->pagetable = 0;
+  release(&np->lock);
+
+  // map this thread's trapframe into the shared page table.
+  // wait_lock serializes changes to the top of the shared
+  // page table with other clone()s and with freeproc().
+  acquire(&wait_lock);
+  acquire(&np->lock);
+  np->trapframeva = THREADFRAME(np - proc);
+  if(mappages(g->pagetable, np->trapframeva, PGSIZE,
+              (uint64)(np->trapframe), PTE_R | PTE_W) < 0){
+    freeproc(np);
+    release(&np->lock);
+    release(&wait_lock);
+    return 0;
+  }
+  np->pagetable = g->pagetable;
+  np->sz = g->sz;
+  np->group = g;
+  np->kthread = kernel;
+  g->nthread++;
+  np->parent = g;
+  np->sibling = g->children;
+  g->children = np;
+  release(&np->lock);
+  release(&wait_lock);
+
+  return np;
+}
+
+// Create a new thread in the current process's address space.
+// The thread starts running fn(arg) on the user stack pointer
+// stack. It shares the page table, open files and current
+// directory, but has its own trapframe and kernel stack.
+// Threads belong to the process that created the first of
+// them (the group), and are reaped with join().
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int tid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct proc *g = p->group ? p->group : p;
+
+  if((np = allocthread(g, 0)) == 0)
+    return -1;
+
+  // start at fn(arg), on the new stack.
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  np->ustack = stack;
+
+  // start on the parent's hart; balance() or an idle
+  // hart may move it.
+  np->affinity = p->affinity;
+  np->cpu = p->cpu;
+  np->stracemask = p->stracemask;
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  tid = np->pid;
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  release(&np->lock);
+  kick(np);
+
+  return tid;
+}
+
+// Create a thread of the current process that runs fn(arg) in
+// the kernel, sharing the address space so that it can copy
+// to and from user memory, but none of the open files. It
+// never returns to user space, and should exit() once killed,
+// which reapthreads() does when the process exits or execs.
+// join() ignores it.
+int
+kthread(void (*fn)(void*), void *arg, char *name)
+{
+  struct proc *np;
+  struct proc *p = myproc();
+  struct proc *g = p->group ? p->group : p;
+
+  if((np = allocthread(g, 1)) == 0)
+    return -1;
+
+  // kthreadstart() finds fn and arg in the unused trapframe.
+  np->context.ra = (uint64)kthreadstart;
+  np->trapframe->epc = (uint64)fn;
+  np->trapframe->a0 = (uint64)arg;
+  np->cwd = cwdget(p);
+  np->affinity = p->affinity;
+  np->cpu = p->cpu;
+  safestrcpy(np->name, name, sizeof(np->name));
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  release(&np->lock);
+  kick(np);
+
+  return np->pid;
+}
+
+// Start a kernel process that runs fn(arg), for work done on
+// behalf of the whole system, such as the log's flusher.
+// Unlike a kthread() it belongs to no group, so exec() and
+// exit() of the process that starts it leave it alone; fn
+// should never return.
+int
+kproc(void (*fn)(void*), void *arg, char *name)
+{
+  struct proc *np;
+
+  if((np = allocproc()) == 0)
+    return -1;
+  np->kthread = 1;
+  np->context.ra = (uint64)kthreadstart;
+  np->trapframe->epc = (uint64)fn;
+  np->trapframe->a0 = (uint64)arg;
+  safestrcpy(np->name, name, sizeof(np->name));
+  release(&np->lock);
+
+  startchild(np);
+  return np->pid;
+}
+
+// Wait for a thread in the caller's group to exit, or for
+// the thread tid if tid isn't -1, and return its id.
+// Copies the stack the thread was created with to addr.
+// Return -1 if there is no such thread.
+int
+join(int tid, uint64 addr)
+{
+  struct proc *np, **pp;
+  int havekids, xtid;
+  struct proc *p = myproc();
+  struct proc *g = p->group ? p->group : p;
+
+  acquire(&wait_lock);
+
+  for(;;){
+    havekids = 0;
+    for(pp = &g->children; (np = *pp) != 0; pp = &np->sibling){
+      if(np->group != g || np == p || np->kthread ||
+         (tid != -1 && np->pid != tid))
+        continue;
+      acquire(&np->lock);
+      havekids = 1;
+      if(np->state == ZOMBIE){
+        xtid = np->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->ustack,
+                                sizeof(np->ustack)) < 0) {
+          release(&np->lock);
+          release(&wait_lock);
+          return -1;
+        }
+        *pp = np->sibling;
+        freeproc(np);
+        release(&np->lock);
+        release(&wait_lock);
+        return xtid;
+      }
+      release(&np->lock);
+    }
+
+    if(!havekids || p->killed){
+      release(&wait_lock);
+      return -1;
+    }
+
+    // exit() of a thread wakes up everyone sleeping on g.
+    sleep(g, &wait_lock);
+  }
+}
+
+// Kill all of p's threads and wait until they have exited,
+// so that p's address space is no longer shared.
+void
+reapthreads(struct proc *p)
+{
+  struct proc *np, **pp;
+
+  acquire(&wait_lock);
+  while(p->nthread > 0){
+    for(pp = &p->children; (np = *pp) != 0; ){
+      if(np->group != p){
+        pp = &np->sibling;
+        continue;
+      }
+      acquire(&np->lock);
+      if(np->state == ZOMBIE){
+        *pp = np->sibling;
+        freeproc(np);
+        release(&np->lock);
+        continue;
+      }
+      np->killed = 1;
+      if(np->state == SLEEPING){
+        // Wake process from sleep().
+        np->state = RUNNABLE;
+        kick(np);
+      }
+      release(&np->lock);
+      pp = &np->sibling;
+    }
+    if(p->nthread > 0)
+      sleep(p, &wait_lock);
+  }
+  release(&wait_lock);
+}
+
+// Make sure that no other hart is still using TLB entries
+// for pagetable, which is shared by threads, after some of
+// its mappings were removed or restricted.
+void
+tlbshootdown(pagetable_t pagetable)
+{
+  struct cpu *c;
+  struct proc *p;
+  int id;
+
+  // make the page table changes visible before looking
+  // at what the other harts are running. a hart that
+  // starts running one of the threads after this point
+  // will flush its TLB in userret anyway.
+  __sync_synchronize();
+
+  push_off();
+  id = cpuid();
+  pop_off();
+
+  // a hart that takes any trap flushes its TLB when it switches
+  // to the kernel page table in uservec, so it only needs to
+  // take the interrupt; ipiintr() acknowledges.
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(c - cpus == id)
+      continue;
+    p = c->proc;
+    if(p == 0 || p->pagetable != pagetable)
+      continue;
+    sendipi(c - cpus, IPI_TLBFLUSH);
+  }
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(c - cpus == id)
+      continue;
+    for(;;){
+      __sync_synchronize();  // re-read c->ipi and c->proc.
+      if((c->ipi & IPI_TLBFLUSH) == 0)
+        break;
+      p = c->proc;
+      if(p == 0 || p->pagetable != pagetable)
+        break;
+    }
+  }
 }
 
 // Pass p's abandoned children to init.
-// Caller must hold p->lock.
+// Caller must hold wait_lock.
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
-
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    // this code uses pp->parent without holding pp->lock.
-    // acquiring the lock first could cause a deadlock
-    // if pp or a child of pp were also in exit()
-    // and about to try to lock p.
-    if(pp->parent == p){
-      // pp->parent can't change between the check and the acquire()
-      // because only the parent changes it, and we're the parent.
-      acquire(&pp->lock);
-      pp->parent = initproc;
-      // we should wake up init here, but that would require
-      // initproc->lock, which would be a deadlock, since we hold
-      // the lock on one of init's children (pp). this is why
-      // exit() always wakes init (before acquiring any locks).
-      release(&pp->lock);
-    }
+  struct proc *pp, *last;
+
+  if(p->children == 0)
+    return;
+
+  last = 0;
+  for(pp = p->children; pp; pp = pp->sibling){
+    pp->parent = initproc;
+    last = pp;
   }
+
+  // splice the whole list onto the front of init's.
+  last->sibling = initproc->children;
+  initproc->children = p->children;
+  p->children = 0;
+
+  // some of them may already be zombies.
+  acquire(&initproc->lock);
+  wakeup1(initproc);
+  release(&initproc->lock);
 }
 
 // Exit the current process.  Does not return.
@@ -337,6 +878,12 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // the address space must outlive all of its threads.
+  if(p->nthread > 0)
+    reapthreads(p);
+  if(p->uring)
+    uringfree(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -346,103 +893,121 @@ exit(int status)
     }
   }
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
-
-  // we might re-parent a child to init. we can't be precise about
-  // waking up init, since we can't acquire its lock once we've
-  // acquired any other proc lock. so wake up init whether that's
-  // necessary or not. init may miss this wakeup, but that seems
-  // harmless.
-  acquire(&initproc->lock);
-  wakeup1(initproc);
-  release(&initproc->lock);
-
-  // grab a copy of p->parent, to ensure that we unlock the same
-  // parent we locked. in case our parent gives us away to init while
-  // we're waiting for the parent lock. we may then race with an
-  // exiting parent, but the result will be a harmless spurious wakeup
-  // to a dead or wrong process; proc structs are never re-allocated
-  // as anything else.
-  acquire(&p->lock);
-  struct proc *original_parent = p->parent;
-  release(&p->lock);
-  
-  // we need the parent's lock in order to wake it up from wait().
-  // the parent-then-child rule says we have to lock it first.
-  acquire(&original_parent->lock);
+  if(p->cwd){  // a thread's is the group's
+    begin_op();
+    iput(p->cwd);
+    end_op();
+    p->cwd = 0;
+  }
 
-  acquire(&p->lock);
+  acquire(&wait_lock);
 
   // Give any children to init.
   reparent(p);
 
-  // Parent might be sleeping in wait().
-  wakeup1(original_parent);
+  if(p->group){
+    // the group and other threads might be sleeping in join().
+    wakeup(p->parent);
+  } else {
+    // Parent might be sleeping in wait().
+    acquire(&p->parent->lock);
+    wakeup1(p->parent);
+    release(&p->parent->lock);
+  }
+
+  acquire(&p->lock);
 
   p->xstate = status;
   p->state = ZOMBIE;
 
-  release(&original_parent->lock);
+  release(&wait_lock);
 
   // Jump into the scheduler, never to return.
   sched();
   panic("zombie exit");
 }
 
+// Add the resource usage in from to that in to.
+static void
+ruadd(struct rusage *to, struct rusage *from)
+{
+  to->utime += from->utime;
+  to->stime += from->stime;
+  to->nvcsw += from->nvcsw;
+  to->nivcsw += from->nivcsw;
+  to->nsegv += from->nsegv;
+  to->rbytes += from->rbytes;
+  to->wbytes += from->wbytes;
+  if(from->maxsz > to->maxsz)
+    to->maxsz = from->maxsz;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
 int
 wait(uint64 addr)
 {
-  struct proc *np;
-  int havekids, pid;
+  return waitpid(-1, addr, 0);
+}
+
+// Wait for the child with the given pid to exit, or for any
+// child if pid is -1, and return its pid.
+// With WNOHANG, return 0 instead of sleeping if no matching
+// child has exited yet.
+// Return -1 if this process has no matching children.
+int
+waitpid(int pid, uint64 addr, int options)
+{
+  struct proc *np, **pp;
+  int havekids, xpid;
   struct proc *p = myproc();
 
-  // hold p->lock for the whole time to avoid lost
+  // hold wait_lock for the whole time to avoid lost
   // wakeups from a child's exit().
-  acquire(&p->lock);
+  acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
     havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      // this code uses np->parent without holding np->lock.
-      // acquiring the lock first would cause a deadlock,
-      // since np might be an ancestor, and we already hold p->lock.
-      if(np->parent == p){
-        // np->parent can't change between the check and the acquire()
-        // because only the parent changes it, and we're the parent.
-        acquire(&np->lock);
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&p->lock);
-            return -1;
-          }
-          freeproc(np);
+    for(pp = &p->children; (np = *pp) != 0; pp = &np->sibling){
+      if(np->group || (pid != -1 && np->pid != pid))
+        continue;
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+      havekids = 1;
+      if(np->state == ZOMBIE){
+        // Found one.
+        xpid = np->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                                sizeof(np->xstate)) < 0) {
           release(&np->lock);
-          release(&p->lock);
-          return pid;
+          release(&wait_lock);
+          return -1;
         }
+        *pp = np->sibling;
+        ruadd(&p->cru, &np->ru);
+        ruadd(&p->cru, &np->cru);
+        freeproc(np);
         release(&np->lock);
+        release(&wait_lock);
+        return xpid;
       }
+      release(&np->lock);
     }
 
     // No point waiting if we don't have any children.
     if(!havekids || p->killed){
-      release(&p->lock);
+      release(&wait_lock);
       return -1;
     }
-    
+
+    if(options & WNOHANG){
+      release(&wait_lock);
+      return 0;
+    }
+
     // Wait for a child to exit.
-    sleep(p, &p->lock);  //DOC: wait-sleep
+    sleep(p, &wait_lock);  //DOC: wait-sleep
   }
 }
 
@@ -453,13 +1018,21 @@ wait(uint64 addr)
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
+//
+// Each process has a home CPU, p->cpu, and a CPU only runs
+// processes whose home it is, so proc[] acts as a set of
+// per-CPU run queues. A CPU with nothing of its own to run
+// steals a RUNNABLE process whose p->affinity allows it,
+// and balance() periodically evens out the queues.
 void
 scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = c - cpus;
   
   c->proc = 0;
+  c->online = 1;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
@@ -467,29 +1040,293 @@ scheduler(void)
     int found = 0;
     for(p = proc; p < &proc[NPROC]; p++) {
       acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-
+      if(p->state == RUNNABLE && p->cpu == id) {
+        run(c, p);
         found = 1;
       }
       release(&p->lock);
     }
-    if(found == 0) {
-      intr_on();
-      asm volatile("wfi");
+    if(found == 0 && (p = steal(id)) != 0){
+      run(c, p);
+      release(&p->lock);
+      found = 1;
     }
+    if(found == 0)
+      idle(c);
   }
 }
 
+// Switch to p, whose lock the caller holds.
+static void
+run(struct cpu *c, struct proc *p)
+{
+  // It is the process's job to release its lock and
+  // then reacquire it before jumping back to us.
+  p->state = RUNNING;
+  c->proc = p;
+  trace(TE_RUN, 0, 0);
+  swtch(&c->context, &p->context);
+
+  // Process is done running for now.
+  // It should have changed its p->state before coming back.
+  trace(TE_STOP, p->state, 0);
+  c->proc = 0;
+
+  // if sched_setaffinity() sent p elsewhere, make sure
+  // its new CPU notices.
+  if(p->state == RUNNABLE && p->cpu != c - cpus)
+    kick(p);
+}
+
+// Find a RUNNABLE process that may run on CPU id but whose
+// home is elsewhere, and make id its home.
+// Returns with p->lock held, or 0 if there is none.
+static struct proc*
+steal(int id)
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    if(p->state != RUNNABLE || (p->affinity & (1L << id)) == 0)
+      continue;
+    acquire(&p->lock);
+    if(p->state == RUNNABLE && (p->affinity & (1L << id))){
+      migrate(p, id);
+      return p;
+    }
+    release(&p->lock);
+  }
+  return 0;
+}
+
+// make CPU id p's home. caller holds p->lock.
+static void
+migrate(struct proc *p, int id)
+{
+  if(p->cpu != id){
+    p->cpu = id;
+    __sync_fetch_and_add(&cpus[id].nmigrate, 1);
+  }
+}
+
+// Is there a RUNNABLE process that CPU id could run?
+// A hint only, since it doesn't take any locks.
+static int
+anyrunnable(int id)
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++)
+    if(p->state == RUNNABLE && (p->affinity & (1L << id)))
+      return 1;
+  return 0;
+}
+
+// Called by scheduler() after a scan found nothing to run.
+// Rather than keep scanning proc[], wait with the timer
+// stopped until kick() sends an IPI_WAKE.
+static void
+idle(struct cpu *c)
+{
+  int id = c - cpus;
+
+  // announce that we're idle before looking one last time, so
+  // that either this look sees a process made RUNNABLE meanwhile,
+  // or the kick() that follows it sees c->idle.
+  c->idle = 1;
+  __sync_synchronize();
+  if(anyrunnable(id)){
+    c->idle = 0;
+    return;
+  }
+
+  // CPU 0 keeps time for everyone, see clockintr().
+  // timers armed on this CPU still wake it up.
+  if(id != 0)
+    tickstop();
+  // look at c->idle and wait with interrupts off, so that a
+  // kick() just after the look can't have its IPI taken before
+  // the wfi, which would then wait for nothing. wfi still wakes
+  // on a pending interrupt; intr_on() takes it.
+  for(;;){
+    intr_off();
+    __sync_synchronize();
+    if(c->idle == 0)
+      break;
+    asm volatile("wfi");
+    intr_on();
+  }
+  if(id != 0)
+    tickstart();
+}
+
+// wake CPU id if it is idle. self is the caller's CPU.
+// returns 1 if CPU id was idle.
+static int
+wakecpu(int id, int self)
+{
+  struct cpu *c = &cpus[id];
+
+  if(c->idle && __sync_bool_compare_and_swap(&c->idle, 1, 0)){
+    if(id != self)
+      sendipi(id, IPI_WAKE);
+    return 1;
+  }
+  return 0;
+}
+
+// p has just been made RUNNABLE; wake up an idle CPU,
+// if there is one, to run it: p's home CPU if that is
+// idle, otherwise one that may steal it.
+static void
+kick(struct proc *p)
+{
+  int i, id, self;
+
+  // order the caller's p->state update before the loads of
+  // c->idle, to pair with the fence in idle().
+  __sync_synchronize();
+
+  push_off();
+  self = cpuid();
+  pop_off();
+
+  if(wakecpu(p->cpu, self))
+    return;
+  for(i = 1; i <= NCPU; i++){
+    id = (self + i) % NCPU;
+    if((p->affinity & (1L << id)) && wakecpu(id, self))
+      return;
+  }
+}
+
+// Count the RUNNABLE and RUNNING processes whose home is
+// each CPU. A snapshot only, since it doesn't take any locks.
+void
+runqlen(int *nrun)
+{
+  struct proc *p;
+
+  memset(nrun, 0, NCPU * sizeof(int));
+  for(p = proc; p < &proc[NPROC]; p++){
+    if(p->state == RUNNABLE || p->state == RUNNING)
+      nrun[p->cpu]++;
+  }
+}
+
+// the CPUs that have started scheduling.
+static uint64
+onlinecpus(void)
+{
+  uint64 mask = 0;
+
+  for(int i = 0; i < NCPU; i++)
+    if(cpus[i].online)
+      mask |= 1L << i;
+  return mask;
+}
+
+// Called by clockintr() every BALANCETICKS ticks.
+// If one CPU's queue is at least two processes longer
+// than another's, move a RUNNABLE process that may
+// run on the shorter one over to it.
+void
+balance(void)
+{
+  int nrun[NCPU];
+  int i, busiest = -1, idlest = -1;
+  uint64 online = onlinecpus();
+  struct proc *p;
+
+  runqlen(nrun);
+  for(i = 0; i < NCPU; i++){
+    if((online & (1L << i)) == 0)
+      continue;
+    if(busiest < 0 || nrun[i] > nrun[busiest])
+      busiest = i;
+    if(idlest < 0 || nrun[i] < nrun[idlest])
+      idlest = i;
+  }
+  if(busiest < 0 || nrun[busiest] - nrun[idlest] < 2)
+    return;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state == RUNNABLE && p->cpu == busiest &&
+       (p->affinity & (1L << idlest))){
+      migrate(p, idlest);
+      release(&p->lock);
+      kick(p);
+      return;
+    }
+    release(&p->lock);
+  }
+}
+
+// Restrict the process with the given pid to the CPUs in mask.
+// Returns -1 if there's no such process, or if mask contains
+// no CPU that is running.
+int
+setaffinity(int pid, uint64 mask)
+{
+  struct proc *p;
+  uint64 allowed;
+  int id, moved;
+
+  mask &= ALLCPUS;
+  allowed = mask & onlinecpus();
+  if(allowed == 0)
+    return -1;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      p->affinity = mask;
+      moved = 0;
+      if((allowed & (1L << p->cpu)) == 0){
+        for(id = 0; (allowed & (1L << id)) == 0; id++)
+          ;
+        migrate(p, id);
+        moved = p->state == RUNNABLE;
+      }
+      release(&p->lock);
+      if(moved)
+        kick(p);
+      // if we are moving ourselves, get off this CPU now;
+      // run() hands us over to our new home.
+      if(p == myproc()){
+        push_off();
+        id = cpuid();
+        pop_off();
+        if((mask & (1L << id)) == 0)
+          yield();
+      }
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
+// Returns the CPU mask of the process with the given pid,
+// or -1 if there's no such process.
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      mask = p->affinity;
+      release(&p->lock);
+      return mask;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
 // Switch to scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -524,6 +1361,7 @@ yield(void)
   struct proc *p = myproc();
   acquire(&p->lock);
   p->state = RUNNABLE;
+  p->ru.nivcsw++;
   sched();
   release(&p->lock);
 }
@@ -549,6 +1387,19 @@ forkret(void)
   usertrapret();
 }
 
+// A kthread()'s or kproc()'s very first scheduling will swtch here.
+static void
+kthreadstart(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  ((void (*)(void*))p->trapframe->epc)((void*)p->trapframe->a0);
+  panic("kthread returned");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -570,6 +1421,8 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->ru.nvcsw++;
+  trace(TE_SLEEP, (uint64)chan, 0);
 
   sched();
 
@@ -589,13 +1442,19 @@ void
 wakeup(void *chan)
 {
   struct proc *p;
+  int woke;
 
   for(p = proc; p < &proc[NPROC]; p++) {
+    woke = 0;
     acquire(&p->lock);
     if(p->state == SLEEPING && p->chan == chan) {
       p->state = RUNNABLE;
+      trace(TE_WAKEUP, (uint64)chan, p->pid);
+      woke = 1;
     }
     release(&p->lock);
+    if(woke)
+      kick(p);
   }
 }
 
@@ -608,6 +1467,8 @@ wakeup1(struct proc *p)
     panic("wakeup1");
   if(p->chan == p && p->state == SLEEPING) {
     p->state = RUNNABLE;
+    trace(TE_WAKEUP, (uint64)p, p->pid);
+    kick(p);
   }
 }
 
@@ -626,6 +1487,7 @@ kill(int pid)
       if(p->state == SLEEPING){
         // Wake process from sleep().
         p->state = RUNNABLE;
+        kick(p);
       }
       release(&p->lock);
       return 0;
@@ -665,6 +1527,57 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
   }
 }
 
+// Copy the resource usage of the current process (who is
+// RUSAGE_SELF) or of its reaped children (RUSAGE_CHILDREN)
+// to user address addr.
+int
+getrusage(int who, uint64 addr)
+{
+  struct proc *p = myproc();
+  struct rusage *ru;
+
+  if(who == RUSAGE_SELF)
+    ru = &p->ru;
+  else if(who == RUSAGE_CHILDREN)
+    ru = &p->cru;
+  else
+    return -1;
+  return copyout(p->pagetable, addr, (char*)ru, sizeof(*ru));
+}
+
+// Copy a struct procinfo for each process, up to n of them,
+// to user address addr. Returns the number copied.
+int
+procinfo(uint64 addr, int n)
+{
+  struct proc *p;
+  struct procinfo pi;
+  int i = 0;
+
+  for(p = proc; p < &proc[NPROC] && i < n; p++){
+    acquire(&wait_lock);
+    acquire(&p->lock);
+    if(p->state == UNUSED){
+      release(&p->lock);
+      release(&wait_lock);
+      continue;
+    }
+    pi.pid = p->pid;
+    pi.ppid = p->parent ? p->parent->pid : 0;
+    pi.state = p->state;
+    pi.cpu = p->cpu;
+    pi.sz = p->sz;
+    safestrcpy(pi.name, p->name, sizeof(pi.name));
+    pi.ru = p->ru;
+    release(&p->lock);
+    release(&wait_lock);
+    if(copyout(myproc()->pagetable, addr + i*sizeof(pi), (char*)&pi, sizeof(pi)) < 0)
+      return -1;
+    i++;
+  }
+  return i;
+}
+
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
@@ -673,6 +1586,7 @@ procdump(void)
 {
   static char *states[] = {
   [UNUSED]    "unused",
+  [USED]      "used  ",
   [SLEEPING]  "sleep ",
   [RUNNABLE]  "runble",
   [RUNNING]   "run   ",
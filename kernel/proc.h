@@ -24,13 +24,25 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint ipi;                   // IPI_* requests pending from other CPUs.
+  int idle;                   // scheduler() is waiting for an IPI_WAKE.
+  int online;                 // scheduler() has started on this CPU.
+  uint64 nmigrate;            // Processes moved here from another CPU.
 };
 
+// reasons for an inter-processor interrupt, see ipi.c.
+#define IPI_TLBFLUSH  0x1  // a shared user page table lost mappings
+#define IPI_WAKE      0x2  // an idle CPU has work to look for
+
 extern struct cpu cpus[NCPU];
 
+// p->affinity of a process that may run anywhere.
+#define ALLCPUS ((1L << NCPU) - 1)
+
 // per-process data for the trap handling code in trampoline.S.
 // sits in a page by itself just under the trampoline page in the
-// user page table. not specially mapped in the kernel page table.
+// user page table (or lower, for a thread; see THREADFRAME).
+// not specially mapped in the kernel page table.
 // the sscratch register points here.
 // uservec in trampoline.S saves user registers in the trapframe,
 // then initializes registers from the trapframe's
@@ -80,7 +92,7 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
-enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
+enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
@@ -88,19 +100,49 @@ struct proc {
 
   // p->lock must be held when using these:
   enum procstate state;        // Process state
-  struct proc *parent;         // Parent process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int vmbusy;                  // A thread is resizing this address space
+  uint64 affinity;             // CPUs this process may run on, 1 << cpuid()
+  int cpu;                     // Home CPU, the only one that runs it unless it migrates
+
+  // wait_lock must be held when using these:
+  struct proc *parent;         // Parent process
+  struct proc *children;       // First child, linked through sibling
+  struct proc *sibling;        // Next child of parent
+  struct proc *group;          // Process whose address space this thread shares, or 0
+  int nthread;                 // Number of threads sharing this process's address space
+  struct uprofbuf *prof;       // Samples of children, see uprof.c
+
+  // updated atomically, with no lock:
+  int vmwalk;                  // Threads copying to or from this address space in software
+
+  // shared with clone()'s threads, see filesproc(). Empty
+  // slots are claimed atomically; filelock must be held to
+  // empty one, to change cwd, or to take references while
+  // other threads may be doing so:
+  struct spinlock filelock;
+  struct file *ofile[NOFILE];  // Open files
+  struct inode *cwd;           // Current directory
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
+  uint64 trapframeva;          // User virtual address of trapframe
+  uint64 ustack;               // Thread's user stack, from clone(), for join()
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct file *argfile;        // argfd()'s reference, dropped when the system call returns
+  struct rusage ru;            // Resources used by this process
+  struct rusage cru;           // ... and by its children, once reaped
+  int profticks;               // Sample user pc every profticks ticks, if non-zero
+  int proftick;                // Ticks since the last sample
+  int profchildren;            // profticks for new children
+  uint64 stracemask;           // Print system calls whose bits are set, see strace()
+  int kthread;                 // Runs only in the kernel, see kthread()
+  struct uring *uring;         // Asynchronous I/O rings, see uring.c
   char name[16];               // Process name (debugging)
 };
@@ -0,0 +1,27 @@
+// Resource usage, from getrusage() and procinfo().
+// Both the kernel and user programs use this header file.
+
+#define RUSAGE_SELF      0  // the calling process
+#define RUSAGE_CHILDREN  1  // its children that have been waited for
+
+struct rusage {
+  uint64 utime;    // ticks spent in user space
+  uint64 stime;    // ticks spent in the kernel
+  uint64 nvcsw;    // voluntary context switches, by sleep()
+  uint64 nivcsw;   // involuntary context switches, by preemption
+  uint64 nsegv;    // page faults, all fatal: there is no demand paging
+  uint64 rbytes;   // bytes returned by read()
+  uint64 wbytes;   // bytes accepted by write()
+  uint64 maxsz;    // peak p->sz, in bytes
+};
+
+// One process, from procinfo().
+struct procinfo {
+  int pid;
+  int ppid;
+  int state;             // see procstate in proc.h; 0 is unused
+  int cpu;               // home CPU
+  uint64 sz;             // memory size, in bytes
+  char name[16];
+  struct rusage ru;
+};
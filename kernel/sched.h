@@ -0,0 +1,7 @@
+// Per-CPU scheduler statistics, from hartstat().
+// Both the kernel and user programs use this header file.
+struct hartstat {
+  int online;       // has started scheduling
+  int nrun;         // RUNNABLE or RUNNING processes whose home it is
+  uint64 nmigrate;  // processes moved to it from other CPUs
+};
@@ -0,0 +1,12 @@
+// Per-system-call counts and latencies, from scstats();
+// see syscall.c.
+// Both the kernel and user programs use this header file.
+
+#define NSCHIST 32   // buckets in a latency histogram
+
+struct scstat {
+  char name[24];          // "" if there is no such system call
+  uint64 count;           // calls made
+  uint64 ns;              // total latency of the calls that returned
+  uint64 hist[NSCHIST];   // calls that took [2^i, 2^(i+1)) ns; hist[0] includes 0
+};
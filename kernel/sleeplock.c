@@ -6,27 +6,66 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "sleeplock.h"
 
+// how long a waiter spins on a holder that is running on
+// another hart before sleeping: 20us of CLINT_MTIME cycles,
+// which covers most buffer locks held by bget() callers.
+#define SLEEPSPIN 200
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
-  initlock(&lk->lk, "sleep lock");
+  initlock(&lk->lk, name);
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->proc = 0;
+}
+
+// Spin while the holder of lk is running and likely to
+// release it soon. Returns when lk is free, or the holder
+// stops running, or it has spun for SLEEPSPIN cycles.
+// The holder's state is read without its lock; a stale
+// answer only makes the waiter spin or sleep too soon.
+static void
+spinwait(struct sleeplock *lk, struct proc *holder)
+{
+  uint64 t0 = readtime();
+
+  while(*(volatile uint*)&lk->locked &&
+        *(volatile enum procstate*)&holder->state == RUNNING &&
+        readtime() - t0 < SLEEPSPIN)
+    ;
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *holder;
+  int spun = 0, slept = 0;
+
   acquire(&lk->lk);
   while (lk->locked) {
+    holder = lk->proc;
+    if(!spun && holder && holder->state == RUNNING){
+      spun = 1;
+      release(&lk->lk);
+      spinwait(lk, holder);
+      acquire(&lk->lk);
+      continue;
+    }
+    slept = 1;
+    lk->lk.nsleep++;
     sleep(lk, &lk->lk);
   }
+  if(spun && !slept)
+    lk->lk.navoid++;
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->proc = myproc();
   release(&lk->lk);
 }
 
@@ -36,10 +75,23 @@ releasesleep(struct sleeplock *lk)
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  lk->proc = 0;
   wakeup(lk);
   release(&lk->lk);
 }
 
+// Hand lk, which the caller holds, over to whoever will
+// release it instead, such as an interrupt handler; waiters
+// sleep rather than spin on the caller meanwhile.
+void
+disownsleep(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  lk->pid = 0;
+  lk->proc = 0;
+  release(&lk->lk);
+}
+
 int
 holdingsleep(struct sleeplock *lk)
 {
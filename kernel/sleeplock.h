@@ -6,5 +6,6 @@ struct sleeplock {
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+  struct proc *proc; // ... and its proc, for adaptive spinning
 };
 
@@ -0,0 +1,17 @@
+// File actions for spawn(), applied in order to the child's
+// copy of the parent's open files before it starts.
+// Both the kernel and user programs use this header file.
+
+#define SPAWN_CLOSE  1  // close fd
+#define SPAWN_DUP2   2  // make fd refer to oldfd's file
+#define SPAWN_OPEN   3  // open path with omode as fd
+
+#define MAXSPAWNFA  16  // max file actions per spawn()
+
+struct spawnfa {
+  int op;       // SPAWN_*
+  int fd;
+  int oldfd;    // SPAWN_DUP2
+  int omode;    // SPAWN_OPEN
+  char *path;   // SPAWN_OPEN
+};
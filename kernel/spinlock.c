@@ -5,15 +5,50 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "rusage.h"
 #include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "time.h"
+#include "lockstat.h"
 #include "defs.h"
 
+// every initialized lock, for the lockstat device. Locks in
+// memory that is freed later must be removed with freelock().
+#define NLOCK 500
+static struct spinlock *locks[NLOCK];
+static struct spinlock lockslock = { .name = "locks" };
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->nacquire = 0;
+  lk->ncontend = 0;
+  lk->nspin = 0;
+  lk->maxhold = 0;
+  lk->nsleep = 0;
+  lk->navoid = 0;
+
+  // a lock that doesn't fit goes without statistics.
+  for(int i = 0; i < NLOCK; i++)
+    if(__sync_bool_compare_and_swap(&locks[i], 0, lk))
+      break;
+}
+
+// Forget a lock whose memory is about to be freed.
+void
+freelock(struct spinlock *lk)
+{
+  acquire(&lockslock);
+  for(int i = 0; i < NLOCK; i++)
+    if(locks[i] == lk)
+      locks[i] = 0;
+  release(&lockslock);
 }
 
 // Acquire the lock.
@@ -21,16 +56,20 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+  uint64 spins = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  // On RISC-V, sync_fetch_and_add turns into an atomic add:
+  //   amoadd.w.aqrl a5, a4, (s1)
+  // Each waiter then polls owner, which only the holder
+  // writes, until its own ticket comes up.
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+  while(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket)
+    spins++;
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,15 +79,26 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  lk->nacquire++;
+  if(spins){
+    lk->ncontend++;
+    lk->nspin += spins;
+  }
+  lk->start = readtime();
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  uint64 held;
+
   if(!holding(lk))
     panic("release");
 
+  held = readtime() - lk->start;
+  if(held > lk->maxhold)
+    lk->maxhold = held;
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,14 +109,10 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code doesn't use a C assignment, since the C standard
-  // implies that an assignment might be implemented with
-  // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  // Hand the lock to the next ticket. Only the holder writes
+  // owner, but the store must be a single one that waiters
+  // can't see half of.
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
 
   pop_off();
 }
@@ -77,7 +123,7 @@ int
 holding(struct spinlock *lk)
 {
   int r;
-  r = (lk->locked && lk->cpu == mycpu());
+  r = (lk->owner != lk->next && lk->cpu == mycpu());
   return r;
 }
 
@@ -108,3 +154,90 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// how often waiters had to wait for a lock, by spinning or,
+// for a sleeplock, sleeping.
+static uint64
+waits(struct lockstat *st)
+{
+  return st->ncontend + st->nsleep + st->navoid;
+}
+
+// Read the statistics of the most contended locks, as many
+// as fit in n bytes, most contended first.
+static int
+lockstatread(int user_dst, uint64 dst, int n)
+{
+  struct lockstat *top, *t, st;
+  struct spinlock *lk;
+  int i, j, ntop, max;
+
+  max = n / sizeof(struct lockstat);
+  if(max > PGSIZE / sizeof(struct lockstat))
+    max = PGSIZE / sizeof(struct lockstat);
+  if((top = (struct lockstat*)kalloc()) == 0)
+    return -1;
+
+  // insertion sort into top[], by waits and then by spins.
+  ntop = 0;
+  acquire(&lockslock);
+  for(i = 0; i < NLOCK; i++){
+    if((lk = locks[i]) == 0 || lk->nacquire == 0)
+      continue;
+    safestrcpy(st.name, lk->name, sizeof(st.name));
+    st.nacquire = lk->nacquire;
+    st.ncontend = lk->ncontend;
+    st.nspin = lk->nspin;
+    st.maxhold = lk->maxhold * (NSEC_PER_SEC / CLINT_FREQ);
+    st.nsleep = lk->nsleep;
+    st.navoid = lk->navoid;
+    for(j = ntop; j > 0; j--){
+      t = &top[j-1];
+      if(waits(t) > waits(&st) ||
+         (waits(t) == waits(&st) && t->nspin >= st.nspin))
+        break;
+      if(j < max)
+        top[j] = *t;
+    }
+    if(j < max){
+      top[j] = st;
+      if(ntop < max)
+        ntop++;
+    }
+  }
+  release(&lockslock);
+
+  n = ntop * sizeof(struct lockstat);
+  if(either_copyout(user_dst, dst, top, n) < 0)
+    n = -1;
+  kfree((char*)top);
+  return n;
+}
+
+// writing resets the statistics of every lock.
+static int
+lockstatwrite(int user_src, uint64 src, int n)
+{
+  struct spinlock *lk;
+
+  acquire(&lockslock);
+  for(int i = 0; i < NLOCK; i++){
+    if((lk = locks[i]) == 0)
+      continue;
+    lk->nacquire = 0;
+    lk->ncontend = 0;
+    lk->nspin = 0;
+    lk->maxhold = 0;
+    lk->nsleep = 0;
+    lk->navoid = 0;
+  }
+  release(&lockslock);
+  return n;
+}
+
+void
+lockstatinit(void)
+{
+  devsw[LOCKSTAT].read = lockstatread;
+  devsw[LOCKSTAT].write = lockstatwrite;
+}
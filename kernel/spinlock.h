@@ -1,9 +1,21 @@
 // Mutual exclusion lock.
+// A ticket lock: acquire() takes the next ticket and waits
+// until owner reaches it, so harts get the lock in the order
+// they asked for it.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out
+  uint owner;        // Ticket now holding the lock
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
-};
 
+  // Statistics, for the lockstat device:
+  uint64 nacquire;   // Times acquired
+  uint64 ncontend;   // Acquires that had to wait
+  uint64 nspin;      // Times waiters polled owner
+  uint64 maxhold;    // Longest hold, in CLINT_MTIME cycles
+  uint64 start;      // When the current holder got it
+  uint64 nsleep;     // For a sleeplock's lk: waits that slept
+  uint64 navoid;     // ... and waits that spinning kept from sleeping
+};
@@ -59,17 +59,19 @@ timerinit()
   // each CPU has a separate source of timer interrupts.
   int id = r_mhartid();
 
-  // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
-  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
+  // no timer interrupt until the supervisor asks for one,
+  // see timer.c.
+  *(uint64*)CLINT_MTIMECMP(id) = -1;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..3] : space for timervec to save registers.
   // scratch[4] : address of CLINT MTIMECMP register.
-  // scratch[5] : desired interval (in cycles) between timer interrupts.
+  // scratch[5] : set by timervec when the timer fires, see timerfired().
+  // scratch[6] : address of CLINT MSIP register, for IPIs.
   uint64 *scratch = &mscratch0[32 * id];
   scratch[4] = CLINT_MTIMECMP(id);
-  scratch[5] = interval;
+  scratch[5] = 0;
+  scratch[6] = CLINT_MSIP(id);
   w_mscratch((uint64)scratch);
 
   // set the machine-mode trap handler.
@@ -78,6 +80,16 @@ timerinit()
   // enable machine-mode interrupts.
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
-  // enable machine-mode timer interrupts.
-  w_mie(r_mie() | MIE_MTIE);
+  // enable machine-mode timer interrupts, and software
+  // interrupts, which other harts send through the CLINT.
+  w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
+}
+
+// timervec and IPIs both arrive in supervisor mode as a software
+// interrupt. called from devintr() to find out whether this
+// hart's timer has fired since the last call.
+int
+timerfired(int id)
+{
+  return __sync_lock_test_and_set(&mscratch0[32 * id + 5], 0) != 0;
 }
@@ -3,8 +3,12 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "syscall.h"
+#include "trace.h"
+#include "time.h"
+#include "scstat.h"
 #include "defs.h"
 
 // Fetch the uint64 at addr from the current process.
@@ -102,6 +106,26 @@ extern uint64 sys_sbrk(void);
 extern uint64 sys_sleep(void);
 extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
+extern uint64 sys_waitpid(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_clock_gettime(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
+extern uint64 sys_hartstat(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_procinfo(void);
+extern uint64 sys_uprof(void);
+extern uint64 sys_uprofread(void);
+extern uint64 sys_strace(void);
+extern uint64 sys_scstats(void);
+extern uint64 sys_uring_setup(void);
+extern uint64 sys_uring_enter(void);
+extern uint64 sys_bcstat(void);
+extern uint64 sys_bcctl(void);
+extern uint64 sys_iostat(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
 
@@ -127,17 +151,222 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_waitpid] sys_waitpid,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_hartstat] sys_hartstat,
+[SYS_spawn]   sys_spawn,
+[SYS_getrusage] sys_getrusage,
+[SYS_procinfo] sys_procinfo,
+[SYS_uprof]   sys_uprof,
+[SYS_uprofread] sys_uprofread,
+[SYS_strace]  sys_strace,
+[SYS_scstats] sys_scstats,
+[SYS_uring_setup] sys_uring_setup,
+[SYS_uring_enter] sys_uring_enter,
+[SYS_bcstat]  sys_bcstat,
+[SYS_bcctl]   sys_bcctl,
+[SYS_iostat]  sys_iostat,
 };
 
+// names and argument types of the system calls, for strace()
+// and scstats(). args has a letter per argument:
+// d for an int, p for a pointer, s for a string.
+static struct {
+  char *name;
+  char *args;
+} scinfo[] = {
+[SYS_fork]    { "fork", "" },
+[SYS_exit]    { "exit", "d" },
+[SYS_wait]    { "wait", "p" },
+[SYS_pipe]    { "pipe", "p" },
+[SYS_read]    { "read", "dpd" },
+[SYS_kill]    { "kill", "d" },
+[SYS_exec]    { "exec", "sp" },
+[SYS_fstat]   { "fstat", "dp" },
+[SYS_chdir]   { "chdir", "s" },
+[SYS_dup]     { "dup", "d" },
+[SYS_getpid]  { "getpid", "" },
+[SYS_sbrk]    { "sbrk", "d" },
+[SYS_sleep]   { "sleep", "d" },
+[SYS_uptime]  { "uptime", "" },
+[SYS_open]    { "open", "sd" },
+[SYS_write]   { "write", "dpd" },
+[SYS_mknod]   { "mknod", "sdd" },
+[SYS_unlink]  { "unlink", "s" },
+[SYS_link]    { "link", "ss" },
+[SYS_mkdir]   { "mkdir", "s" },
+[SYS_close]   { "close", "d" },
+[SYS_waitpid] { "waitpid", "dpd" },
+[SYS_clone]   { "clone", "ppp" },
+[SYS_join]    { "join", "dp" },
+[SYS_nanosleep] { "nanosleep", "p" },
+[SYS_clock_gettime] { "clock_gettime", "dp" },
+[SYS_sched_setaffinity] { "sched_setaffinity", "dp" },
+[SYS_sched_getaffinity] { "sched_getaffinity", "d" },
+[SYS_hartstat] { "hartstat", "pd" },
+[SYS_spawn]   { "spawn", "sppd" },
+[SYS_getrusage] { "getrusage", "dp" },
+[SYS_procinfo] { "procinfo", "pd" },
+[SYS_uprof]   { "uprof", "d" },
+[SYS_uprofread] { "uprofread", "pd" },
+[SYS_strace]  { "strace", "p" },
+[SYS_scstats] { "scstats", "pd" },
+[SYS_uring_setup] { "uring_setup", "d" },
+[SYS_uring_enter] { "uring_enter", "dd" },
+[SYS_bcstat]  { "bcstat", "p" },
+[SYS_bcctl]   { "bcctl", "dd" },
+[SYS_iostat]  { "iostat", "p" },
+};
+
+#define NSCARG 6    // most arguments a system call takes
+#define SCSTR  32   // longest string argument strace() shows
+
+// a system call's arguments, saved for strace() before the
+// call overwrites them.
+struct scargs {
+  char type[NSCARG+1];   // as in scinfo, but p for unreadable strings
+  uint64 a[NSCARG+1];    // room for the return value after them
+  char str[NSCARG][SCSTR];
+};
+
+// per-CPU counts and latency histograms. Each CPU updates only
+// its own, with interrupts off, so they need no lock.
+static struct {
+  uint64 count;
+  uint64 ns;
+  uint64 hist[NSCHIST];
+} scstat[NCPU][NELEM(syscalls)];
+
+static void
+scsave(struct scargs *sa, int num)
+{
+  char *t = scinfo[num].args;
+  int i;
+
+  for(i = 0; t[i]; i++){
+    sa->type[i] = t[i];
+    sa->a[i] = argraw(i);
+    if(t[i] == 's'){
+      if(fetchstr(sa->a[i], sa->str[i], SCSTR) >= 0)
+        sa->a[i] = (uint64)sa->str[i];
+      else
+        sa->type[i] = 'p';
+    }
+  }
+  sa->type[i] = 0;
+}
+
+// print a traced system call, its arguments and what it
+// returned, e.g. "3 sh: read(0, 0x0000000000003f50, 1) = 1".
+// One printf() keeps lines from different harts apart, so
+// build its format to match the arguments.
+static void
+scprint(struct scargs *sa, int num, char *ret)
+{
+  struct proc *p = myproc();
+  char fmt[16 + NSCARG*6 + 16];
+  int i, n;
+
+  safestrcpy(fmt, "%d %s: %s(", sizeof(fmt));
+  n = strlen(fmt);
+  for(i = 0; sa->type[i]; i++){
+    if(i > 0){
+      fmt[n++] = ',';
+      fmt[n++] = ' ';
+    }
+    if(sa->type[i] == 's'){
+      safestrcpy(fmt + n, "\"%s\"", 5);
+      n += 4;
+    } else {
+      fmt[n++] = '%';
+      fmt[n++] = sa->type[i];
+    }
+  }
+  safestrcpy(fmt + n, ret, sizeof(fmt) - n);
+  printf(fmt, p->pid, p->name, scinfo[num].name, sa->a[0], sa->a[1],
+         sa->a[2], sa->a[3], sa->a[4], sa->a[5], sa->a[6]);
+}
+
+// count a call that took cycles of CLINT_MTIME.
+static void
+scaccount(int num, uint64 cycles)
+{
+  uint64 ns = cycles * (NSEC_PER_SEC / CLINT_FREQ);
+  int b;
+
+  for(b = 0; b < NSCHIST-1 && (ns >> (b+1)) != 0; b++)
+    ;
+  push_off();
+  scstat[cpuid()][num].ns += ns;
+  scstat[cpuid()][num].hist[b]++;
+  pop_off();
+}
+
+// copy the statistics of up to n system calls, summed over
+// the CPUs, to user address addr. Returns how many system
+// call numbers there are.
+int
+scstats(uint64 addr, int n)
+{
+  struct scstat st;
+  int num, c, i;
+
+  if(n > NELEM(syscalls))
+    n = NELEM(syscalls);
+  for(num = 0; num < n; num++){
+    memset(&st, 0, sizeof(st));
+    if(syscalls[num])
+      safestrcpy(st.name, scinfo[num].name, sizeof(st.name));
+    for(c = 0; c < NCPU; c++){
+      st.count += scstat[c][num].count;
+      st.ns += scstat[c][num].ns;
+      for(i = 0; i < NSCHIST; i++)
+        st.hist[i] += scstat[c][num].hist[i];
+    }
+    if(copyout(myproc()->pagetable, addr + num*sizeof(st),
+               (char*)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return NELEM(syscalls);
+}
+
 void
 syscall(void)
 {
-  int num;
+  int num, traced;
   struct proc *p = myproc();
+  struct scargs sa;
+  uint64 t0;
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    trace(TE_SYSCALL, num, 0);
+    push_off();
+    scstat[cpuid()][num].count++;
+    pop_off();
+    traced = (p->stracemask >> num) & 1;
+    if(traced){
+      scsave(&sa, num);
+      if(num == SYS_exit)
+        scprint(&sa, num, ") = ?\n");
+    }
+    t0 = readtime();
     p->trapframe->a0 = syscalls[num]();
+    if(p->argfile){
+      fileclose(p->argfile);
+      p->argfile = 0;
+    }
+    scaccount(num, readtime() - t0);
+    if(traced){
+      sa.a[strlen(sa.type)] = p->trapframe->a0;
+      scprint(&sa, num, ") = %d\n");
+    }
+    trace(TE_SYSRET, num, p->trapframe->a0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
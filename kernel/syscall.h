@@ -20,3 +20,23 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_waitpid 22
+#define SYS_clone  23
+#define SYS_join   24
+#define SYS_nanosleep 25
+#define SYS_clock_gettime 26
+#define SYS_sched_setaffinity 27
+#define SYS_sched_getaffinity 28
+#define SYS_hartstat 29
+#define SYS_spawn  30
+#define SYS_getrusage 31
+#define SYS_procinfo 32
+#define SYS_uprof  33
+#define SYS_uprofread 34
+#define SYS_strace 35
+#define SYS_scstats 36
+#define SYS_uring_setup 37
+#define SYS_uring_enter 38
+#define SYS_bcstat 39
+#define SYS_bcctl  40
+#define SYS_iostat 41
@@ -10,24 +10,45 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "spawn.h"
+#include "bcstat.h"
+#include "iostat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
+// If other threads share the descriptors, one of them could close
+// it meanwhile, so hold a reference until the system call returns.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
   int fd;
   struct file *f;
+  struct proc *p = myproc(), *fp = filesproc(p);
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE)
     return -1;
+  if(fp == p && p->nthread == 0){
+    if((f=p->ofile[fd]) == 0)
+      return -1;
+  } else {
+    acquire(&fp->filelock);
+    if((f=fp->ofile[fd]) != 0)
+      filedup(f);
+    release(&fp->filelock);
+    if(f == 0)
+      return -1;
+    if(p->argfile)
+      panic("argfd");
+    p->argfile = f;
+  }
   if(pfd)
     *pfd = fd;
   if(pf)
@@ -39,15 +60,22 @@ argfd(int n, int *pfd, struct file **pf)
 // Takes over file reference from caller on success.
 static int
 fdalloc(struct file *f)
+{
+  return fdallocproc(filesproc(myproc()), f);
+}
+
+// fdalloc() in p, which may not be the current process:
+// a uring worker opens files for the process it serves
+// while that process runs, as do threads for their group,
+// so claim the slot atomically.
+int
+fdallocproc(struct proc *p, struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
 
   for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
+    if(__sync_bool_compare_and_swap(&p->ofile[fd], 0, f))
       return fd;
-    }
   }
   return -1;
 }
@@ -96,10 +124,18 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct proc *fp = filesproc(myproc());
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
+  acquire(&fp->filelock);
+  if(fp->ofile[fd] != f){
+    // another thread closed it first.
+    release(&fp->filelock);
+    return -1;
+  }
+  fp->ofile[fd] = 0;
+  release(&fp->filelock);
   fileclose(f);
   return 0;
 }
@@ -283,17 +319,13 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-uint64
-sys_open(void)
+// Open path for sys_open(), spawn() or a uring.
+// Returns a new struct file, or 0.
+struct file*
+openfile(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
-    return -1;
 
   begin_op();
 
@@ -301,33 +333,31 @@ sys_open(void)
     ip = create(path, T_FILE, 0, 0);
     if(ip == 0){
       end_op();
-      return -1;
+      return 0;
     }
   } else {
     if((ip = namei(path)) == 0){
       end_op();
-      return -1;
+      return 0;
     }
     ilock(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
       end_op();
-      return -1;
+      return 0;
     }
   }
 
   if(ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
   if(ip->type == T_DEVICE){
@@ -348,6 +378,24 @@ sys_open(void)
   iunlock(ip);
   end_op();
 
+  return f;
+}
+
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int fd, omode;
+  struct file *f;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  if((f = openfile(path, omode)) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -391,8 +439,8 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
-  struct proc *p = myproc();
+  struct inode *ip, *old;
+  struct proc *fp;
   
   begin_op();
   if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
@@ -406,29 +454,32 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  fp = filesproc(myproc());
+  acquire(&fp->filelock);
+  old = fp->cwd;
+  fp->cwd = ip;
+  release(&fp->filelock);
+  iput(old);
   end_op();
-  p->cwd = ip;
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Fetch the user argv array at uargv into argv[MAXARG],
+// with each string in a page from kalloc().
+// On failure, the caller still frees argv with freeargv().
+static int
+fetchargv(uint64 uargv, char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
+  uint64 uarg;
 
-  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(argv[0]));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
-      goto bad;
+    if(i >= MAXARG){
+      return -1;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
-      goto bad;
+      return -1;
     }
     if(uarg == 0){
       argv[i] = 0;
@@ -436,22 +487,115 @@ sys_exec(void)
     }
     argv[i] = kalloc();
     if(argv[i] == 0)
-      goto bad;
+      return -1;
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+      return -1;
   }
+  return 0;
+}
 
-  int ret = exec(path, argv);
+static void
+freeargv(char **argv)
+{
+  int i;
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
     kfree(argv[i]);
+}
+
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+  int ret;
 
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  ret = -1;
+  if(fetchargv(uargv, argv) == 0)
+    ret = exec(path, argv);
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+// Apply the nfa file actions at user address ufa to the
+// open files of np, a new process from spawnalloc().
+static int
+spawnfa(struct proc *np, uint64 ufa, int nfa)
+{
+  struct spawnfa fa;
+  char path[MAXPATH];
+  struct file *f;
+  int i;
+
+  if(nfa < 0 || nfa > MAXSPAWNFA)
+    return -1;
+  for(i = 0; i < nfa; i++){
+    if(copyin(myproc()->pagetable, (char*)&fa, ufa + i*sizeof(fa), sizeof(fa)) < 0)
+      return -1;
+    if(fa.fd < 0 || fa.fd >= NOFILE)
+      return -1;
+    switch(fa.op){
+    case SPAWN_CLOSE:
+      f = 0;
+      break;
+    case SPAWN_DUP2:
+      if(fa.oldfd < 0 || fa.oldfd >= NOFILE || np->ofile[fa.oldfd] == 0)
+        return -1;
+      f = filedup(np->ofile[fa.oldfd]);
+      break;
+    case SPAWN_OPEN:
+      if(fetchstr((uint64)fa.path, path, MAXPATH) < 0)
+        return -1;
+      if((f = openfile(path, fa.omode)) == 0)
+        return -1;
+      break;
+    default:
+      return -1;
+    }
+    if(np->ofile[fa.fd])
+      fileclose(np->ofile[fa.fd]);
+    np->ofile[fa.fd] = f;
+  }
+  return 0;
+}
+
+// Start the program in path as a new child process,
+// without first copying the caller as fork() would.
+// The child gets the caller's open files, as changed by
+// the file actions, and returns the child's pid.
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv, ufa;
+  int nfa, argc, pid;
+  struct proc *np;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0 ||
+     argaddr(2, &ufa) < 0 || argint(3, &nfa) < 0)
+    return -1;
+  if(fetchargv(uargv, argv) < 0){
+    freeargv(argv);
+    return -1;
+  }
+  if((np = spawnalloc()) == 0){
+    freeargv(argv);
+    return -1;
+  }
+  if(spawnfa(np, ufa, nfa) < 0 || (argc = execimage(np, path, argv)) < 0){
+    spawnfree(np);
+    freeargv(argv);
+    return -1;
+  }
+  freeargv(argv);
+
+  np->trapframe->a0 = argc;
+  pid = np->pid;
+  startchild(np);
+  return pid;
 }
 
 uint64
@@ -460,7 +604,7 @@ sys_pipe(void)
   uint64 fdarray; // user pointer to array of two integers
   struct file *rf, *wf;
   int fd0, fd1;
-  struct proc *p = myproc();
+  struct proc *p = myproc(), *fp = filesproc(p);
 
   if(argaddr(0, &fdarray) < 0)
     return -1;
@@ -469,18 +613,78 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
+      fp->ofile[fd0] = 0;
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    fp->ofile[fd0] = 0;
+    fp->ofile[fd1] = 0;
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   return 0;
 }
+
+uint64
+sys_uring_setup(void)
+{
+  int nworker;
+
+  if(argint(0, &nworker) < 0)
+    return -1;
+  return uringsetup(nworker);
+}
+
+uint64
+sys_uring_enter(void)
+{
+  int n, min;
+
+  if(argint(0, &n) < 0 || argint(1, &min) < 0)
+    return -1;
+  return uringenter(n, min);
+}
+
+uint64
+sys_bcstat(void)
+{
+  struct bcstat st;
+  uint64 addr;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  bcstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_bcctl(void)
+{
+  int policy, maxbuf;
+
+  if(argint(0, &policy) < 0 || argint(1, &maxbuf) < 0)
+    return -1;
+  return bcctl(policy, maxbuf);
+}
+
+uint64
+sys_iostat(void)
+{
+  struct iostat st;
+  uint64 addr;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  bcstat(&st.cache);
+  logstat(&st.log);
+  virtio_disk_stat(&st.disk);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
@@ -5,7 +5,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
+#include "time.h"
+#include "sched.h"
 
 uint64
 sys_exit(void)
@@ -38,6 +41,193 @@ sys_wait(void)
   return wait(p);
 }
 
+uint64
+sys_waitpid(void)
+{
+  int pid, options;
+  uint64 p;
+  if(argint(0, &pid) < 0 || argaddr(1, &p) < 0 || argint(2, &options) < 0)
+    return -1;
+  return waitpid(pid, p, options);
+}
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 || argaddr(2, &stack) < 0)
+    return -1;
+  // riscv sp must be 16-byte aligned
+  if(stack % 16 != 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
+uint64
+sys_join(void)
+{
+  int tid;
+  uint64 p;
+
+  if(argint(0, &tid) < 0 || argaddr(1, &p) < 0)
+    return -1;
+  return join(tid, p);
+}
+
+// sleep for the given number of nanoseconds.
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns;
+
+  if(argaddr(0, &ns) < 0)
+    return -1;
+  return nanosleep(ns);
+}
+
+uint64
+sys_clock_gettime(void)
+{
+  int clock;
+  uint64 addr;
+  uint64 now;
+  struct timespec ts;
+
+  if(argint(0, &clock) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  if(clock != CLOCK_MONOTONIC)
+    return -1;
+  now = readtime();
+  ts.tv_sec = now / CLINT_FREQ;
+  ts.tv_nsec = (now % CLINT_FREQ) * (NSEC_PER_SEC / CLINT_FREQ);
+  if(copyout(myproc()->pagetable, addr, (char*)&ts, sizeof(ts)) < 0)
+    return -1;
+  return 0;
+}
+
+// pid 0 means the calling process.
+uint64
+sys_sched_setaffinity(void)
+{
+  int pid;
+  uint64 mask;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &mask) < 0)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  return setaffinity(pid, mask);
+}
+
+uint64
+sys_sched_getaffinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  return getaffinity(pid);
+}
+
+// copy out up to n struct hartstats, one per CPU.
+// returns the number copied.
+uint64
+sys_hartstat(void)
+{
+  int n, i;
+  uint64 addr;
+  int nrun[NCPU];
+  struct hartstat hs;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NCPU)
+    n = NCPU;
+  runqlen(nrun);
+  for(i = 0; i < n; i++){
+    hs.online = cpus[i].online;
+    hs.nrun = nrun[i];
+    hs.nmigrate = cpus[i].nmigrate;
+    if(copyout(myproc()->pagetable, addr + i*sizeof(hs), (char*)&hs, sizeof(hs)) < 0)
+      return -1;
+  }
+  return n;
+}
+
+uint64
+sys_getrusage(void)
+{
+  int who;
+  uint64 addr;
+
+  if(argint(0, &who) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  return getrusage(who, addr);
+}
+
+// copy out up to n struct procinfos, one per process.
+// returns the number copied.
+uint64
+sys_procinfo(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return procinfo(addr, n);
+}
+
+// sample the user pc of children created from now
+// on every n ticks; 0 stops.
+uint64
+sys_uprof(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return uprof(n);
+}
+
+uint64
+sys_uprofread(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return uprofread(addr, n);
+}
+
+// print the system calls whose bits are set in mask, for
+// this process and the children it creates from now on.
+uint64
+sys_strace(void)
+{
+  uint64 mask;
+
+  if(argaddr(0, &mask) < 0)
+    return -1;
+  myproc()->stracemask = mask;
+  return 0;
+}
+
+uint64
+sys_scstats(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return scstats(addr, n);
+}
+
 uint64
 sys_sbrk(void)
 {
@@ -56,21 +246,10 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return sleepticks(n);
 }
 
 uint64
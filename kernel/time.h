@@ -0,0 +1,11 @@
+// Clocks for clock_gettime().
+// Both the kernel and user programs use this header file.
+
+#define CLOCK_MONOTONIC  1  // time since boot, from CLINT_MTIME
+
+#define NSEC_PER_SEC  1000000000L
+
+struct timespec {
+  uint64 tv_sec;
+  uint64 tv_nsec;
+};
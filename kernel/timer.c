@@ -0,0 +1,245 @@
+//
+// One-shot timers.
+//
+// Each CPU keeps a queue of pending timers, sorted by deadline,
+// and programs its CLINT_MTIMECMP register for whichever comes
+// first: the earliest timer, or the next scheduler tick.
+// timervec in kernelvec.S disarms mtimecmp when it fires, and
+// devintr() calls timerintr() to run the expired timers and
+// program the next deadline.
+//
+// Deadlines are in CLINT_MTIME cycles, CLINT_FREQ per second.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "timer.h"
+#include "time.h"
+#include "defs.h"
+
+// cycles between scheduler ticks.
+#define TICKCYCLES (CLINT_FREQ / TICKHZ)
+
+struct timerq {
+  struct spinlock lock;
+  struct timer *head;  // pending timers, earliest first
+  uint64 tick;         // deadline of the next tick, or 0 if stopped
+};
+
+static struct timerq timerq[NCPU];
+
+// cycles since boot.
+uint64
+readtime(void)
+{
+  return *(volatile uint64*)CLINT_MTIME;
+}
+
+void
+timerqinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&timerq[i].lock, "timerq");
+}
+
+// start this CPU's scheduler tick.
+void
+timerqinithart(void)
+{
+  tickstart();
+}
+
+// program this CPU's mtimecmp for the earliest deadline in q.
+// caller holds q->lock, and q is this CPU's queue.
+static void
+program(struct timerq *q)
+{
+  uint64 when = -1;
+
+  if(q->head)
+    when = q->head->when;
+  if(q->tick && q->tick < when)
+    when = q->tick;
+  *(uint64*)CLINT_MTIMECMP(q - timerq) = when;
+}
+
+// lock and return this CPU's queue.
+static struct timerq*
+lockmyq(void)
+{
+  struct timerq *q;
+
+  push_off();
+  q = &timerq[cpuid()];
+  acquire(&q->lock);
+  pop_off();
+  return q;
+}
+
+// insert t, with t->when set, into q, which the caller has locked.
+static void
+insert(struct timerq *q, struct timer *t)
+{
+  struct timer **tp;
+
+  for(tp = &q->head; *tp && (*tp)->when <= t->when; tp = &(*tp)->next)
+    ;
+  t->next = *tp;
+  *tp = t;
+  t->q = q;
+  if(q->head == t)
+    program(q);
+}
+
+// remove t from q, which the caller has locked.
+static void
+remove(struct timerq *q, struct timer *t)
+{
+  struct timer **tp;
+
+  for(tp = &q->head; *tp; tp = &(*tp)->next){
+    if(*tp == t){
+      *tp = t->next;
+      break;
+    }
+  }
+  t->next = 0;
+  t->q = 0;
+}
+
+// Arrange for fn(t) to be called from the timer interrupt on
+// this CPU at time when (in cycles). fn runs with interrupts off
+// and the queue's lock held, so it must be short, and may only
+// take locks that are never held while calling settimer().
+void
+settimer(struct timer *t, uint64 when, void (*fn)(struct timer*), void *arg)
+{
+  struct timerq *q;
+
+  t->when = when;
+  t->fn = fn;
+  t->arg = arg;
+  q = lockmyq();
+  insert(q, t);
+  release(&q->lock);
+}
+
+// Remove t if it hasn't fired yet.
+// Returns 1 if it was pending, 0 if it has fired.
+int
+canceltimer(struct timer *t)
+{
+  struct timerq *q;
+  int pending = 0;
+
+  // t->q can be read without the lock because only
+  // canceltimer() and the timer interrupt clear it,
+  // and a timer isn't re-armed while being cancelled.
+  if((q = t->q) == 0)
+    return 0;
+  acquire(&q->lock);
+  if(t->q == q){
+    remove(q, t);
+    pending = 1;
+  }
+  release(&q->lock);
+  return pending;
+}
+
+// Called from devintr() when this CPU's timer has fired.
+// Runs expired timers and programs the next deadline.
+// Returns 1 if the scheduler tick is due, 0 if not.
+int
+timerintr(void)
+{
+  struct timerq *q = &timerq[cpuid()];
+  struct timer *t;
+  uint64 now;
+  int tick = 0;
+
+  acquire(&q->lock);
+  now = readtime();
+  while((t = q->head) != 0 && t->when <= now){
+    remove(q, t);
+    t->fn(t);
+  }
+  if(q->tick && q->tick <= now){
+    tick = 1;
+    q->tick += TICKCYCLES;
+    if(q->tick <= now)
+      q->tick = now + TICKCYCLES;  // we fell behind; don't catch up
+  }
+  program(q);
+  release(&q->lock);
+  return tick;
+}
+
+// Stop this CPU's scheduler tick, e.g. while it's idle.
+// Timers still fire.
+void
+tickstop(void)
+{
+  struct timerq *q = lockmyq();
+
+  q->tick = 0;
+  program(q);
+  release(&q->lock);
+}
+
+// (Re)start this CPU's scheduler tick.
+void
+tickstart(void)
+{
+  struct timerq *q = lockmyq();
+
+  q->tick = readtime() + TICKCYCLES;
+  program(q);
+  release(&q->lock);
+}
+
+static void
+timerwakeup(struct timer *t)
+{
+  wakeup(t);
+}
+
+// Sleep for at least ns nanoseconds, with the resolution of
+// CLINT_MTIME rather than of the scheduler tick.
+// Returns -1 if killed first.
+int
+nanosleep(uint64 ns)
+{
+  struct timer t;
+  struct timerq *q;
+  struct proc *p = myproc();
+  uint64 cycles;
+
+  cycles = ns / (NSEC_PER_SEC / CLINT_FREQ);
+  if(cycles > (uint64)-1 / 2)
+    cycles = (uint64)-1 / 2;
+
+  // hold the queue lock from arming the timer until
+  // sleep(), so that timerwakeup() can't be missed.
+  q = lockmyq();
+  t.when = readtime() + cycles;
+  t.fn = timerwakeup;
+  t.arg = p;
+  insert(q, &t);
+  while(t.q != 0){
+    if(p->killed){
+      remove(q, &t);
+      release(&q->lock);
+      return -1;
+    }
+    // we may wake up on another CPU, but t stays
+    // in the queue of the one we armed it on.
+    sleep(&t, &q->lock);
+  }
+  release(&q->lock);
+  return 0;
+}
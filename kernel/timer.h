@@ -0,0 +1,17 @@
+// A one-shot timer, see timer.c.
+struct timer {
+  uint64 when;                   // deadline, in CLINT_MTIME cycles
+  void (*fn)(struct timer*);     // called at when, from the timer interrupt
+  void *arg;                     // for fn's use
+  struct timer *next;            // in the queue of q
+  struct timerq *q;              // queue while pending, else 0
+};
+
+// A timer on the tick-based wheel, see wheel.c.
+struct wtimer {
+  uint64 when;                   // deadline, in ticks
+  void (*fn)(struct wtimer*);    // called at when, from clockintr()
+  void *arg;                     // for fn's use
+  struct wtimer *next;           // in the wheel slot
+  struct wtimer **pprev;         // link to this timer while pending, else 0
+};
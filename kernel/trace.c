@@ -0,0 +1,139 @@
+//
+// Kernel event trace.
+//
+// trace() appends a timestamped event to a ring for the
+// current CPU, if the event's category is enabled. Writing a
+// number to the ktrace device sets the mask of enabled
+// categories (TC_* in trace.h); reading it drains the rings
+// as struct tevents. user/ktrace drives it, and ktrace.py
+// converts what it prints into a Chrome trace.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "trace.h"
+#include "defs.h"
+
+#define NEVENT 512  // per CPU
+
+static char category[NTE] = {
+[TE_RUN]         TC_SCHED,
+[TE_STOP]        TC_SCHED,
+[TE_SLEEP]       TC_SLEEP,
+[TE_WAKEUP]      TC_SLEEP,
+[TE_BEGIN_OP]    TC_LOG,
+[TE_END_OP]      TC_LOG,
+[TE_COMMIT]      TC_LOG,
+[TE_COMMITTED]   TC_LOG,
+[TE_BGET_HIT]    TC_BCACHE,
+[TE_BGET_MISS]   TC_BCACHE,
+[TE_DISK_SUBMIT] TC_DISK,
+[TE_DISK_DONE]   TC_DISK,
+[TE_SYSCALL]     TC_SYSCALL,
+[TE_SYSRET]      TC_SYSCALL,
+};
+
+struct ring {
+  struct spinlock lock;
+  uint head, tail;     // events are at [tail, head)
+  uint dropped;        // events lost because the ring was full
+  struct tevent e[NEVENT];
+};
+
+static struct {
+  int mask;            // enabled categories
+  struct ring ring[NCPU];
+} ktrace;
+
+// Record an event of type, if its category is enabled.
+void
+trace(int type, uint64 arg0, uint64 arg1)
+{
+  struct ring *r;
+  struct tevent *e;
+  struct proc *p;
+
+  if((ktrace.mask & category[type]) == 0)
+    return;
+
+  push_off();
+  r = &ktrace.ring[cpuid()];
+  p = mycpu()->proc;
+  acquire(&r->lock);
+  if(r->head - r->tail == NEVENT){
+    r->dropped++;
+  } else {
+    e = &r->e[r->head % NEVENT];
+    e->time = readtime();
+    e->type = type;
+    e->hart = cpuid();
+    e->pid = p ? p->pid : 0;
+    e->arg0 = arg0;
+    e->arg1 = arg1;
+    r->head++;
+  }
+  release(&r->lock);
+  pop_off();
+}
+
+// read as many whole events as fit in n bytes.
+static int
+ktraceread(int user_dst, uint64 dst, int n)
+{
+  struct ring *r;
+  struct tevent e;
+  int i, got = 0;
+
+  for(i = 0; i < NCPU; i++){
+    r = &ktrace.ring[i];
+    acquire(&r->lock);
+    while(r->tail != r->head && n - got >= sizeof(e)){
+      e = r->e[r->tail % NEVENT];
+      r->tail++;
+      release(&r->lock);
+      if(either_copyout(user_dst, dst + got, &e, sizeof(e)) < 0)
+        return -1;
+      got += sizeof(e);
+      acquire(&r->lock);
+    }
+    release(&r->lock);
+  }
+  return got;
+}
+
+// set the mask of enabled categories from the decimal
+// number written.
+static int
+ktracewrite(int user_src, uint64 src, int n)
+{
+  char c;
+  int i, mask = 0;
+
+  for(i = 0; i < n; i++){
+    if(either_copyin(&c, user_src, src + i, 1) < 0)
+      return -1;
+    if(c < '0' || c > '9')
+      break;
+    mask = mask*10 + c - '0';
+  }
+  if(i > 0)
+    ktrace.mask = mask & TC_ALL;
+  return n;
+}
+
+void
+traceinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&ktrace.ring[i].lock, "ktrace");
+  devsw[KTRACE].read = ktraceread;
+  devsw[KTRACE].write = ktracewrite;
+}
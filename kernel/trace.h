@@ -0,0 +1,38 @@
+// Events in the kernel trace, read from the ktrace device;
+// see trace.c.
+// Both the kernel and user programs use this header file.
+
+// categories of events, for the mask written to ktrace.
+#define TC_SCHED     0x01
+#define TC_SLEEP     0x02
+#define TC_LOG       0x04
+#define TC_BCACHE    0x08
+#define TC_DISK      0x10
+#define TC_SYSCALL   0x20
+#define TC_ALL       0x3f
+
+// events, and what their arguments hold.
+#define TE_RUN          1  // pid starts running on hart
+#define TE_STOP         2  // pid stops running; arg0 = its new state
+#define TE_SLEEP        3  // arg0 = chan
+#define TE_WAKEUP       4  // arg0 = chan, arg1 = pid woken up
+#define TE_BEGIN_OP     5
+#define TE_END_OP       6
+#define TE_COMMIT       7  // commit starts; arg0 = blocks in the transaction
+#define TE_COMMITTED    8
+#define TE_BGET_HIT     9  // arg0 = dev, arg1 = blockno
+#define TE_BGET_MISS   10  // arg0 = dev, arg1 = blockno
+#define TE_DISK_SUBMIT 11  // arg0 = blockno, arg1 = 1 if a write
+#define TE_DISK_DONE   12  // arg0 = blockno, arg1 = 1 if a write
+#define TE_SYSCALL     13  // arg0 = system call number
+#define TE_SYSRET      14  // arg0 = system call number, arg1 = return value
+#define NTE            15
+
+struct tevent {
+  uint64 time;      // CLINT_MTIME cycles
+  ushort type;      // TE_*
+  ushort hart;
+  int pid;          // current process, or 0
+  uint64 arg0;
+  uint64 arg1;
+};
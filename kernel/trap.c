@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
 
@@ -68,6 +69,8 @@ usertrap(void)
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
+    if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15)
+      p->ru.nsegv++;
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
     p->killed = 1;
@@ -76,9 +79,15 @@ usertrap(void)
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this is a timer interrupt,
+  // charging the tick to the process's user time.
+  if(which_dev == 2){
+    p->ru.utime++;
+    kprofuser(p);
+    if(p->profticks)
+      uprofsample(p);
     yield();
+  }
 
   usertrapret();
 }
@@ -125,7 +134,7 @@ usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(p->trapframeva, satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -149,6 +158,15 @@ kerneltrap()
     panic("kerneltrap");
   }
 
+  // charge the tick to the current process's system time.
+  if(which_dev == 2 && myproc() != 0)
+    myproc()->ru.stime++;
+
+  // kernelvec doesn't touch s0, so our prologue saved the
+  // interrupted code's frame pointer at fp-16.
+  if(which_dev == 2)
+    kprofkernel(sepc, *(uint64*)(r_fp() - 16));
+
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
     yield();
@@ -162,10 +180,17 @@ kerneltrap()
 void
 clockintr()
 {
+  int dobalance;
+
   acquire(&tickslock);
   ticks++;
-  wakeup(&ticks);
+  // under tickslock, so that uptime() never runs ahead of the wheel.
+  wheeltick();
+  dobalance = ticks % BALANCETICKS == 0;
   release(&tickslock);
+
+  if(dobalance)
+    balance();
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -201,16 +226,26 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or IPI, forwarded by timervec in kernelvec.S.
+
+    // acknowledge the software interrupt by clearing
+    // the SSIP bit in sip, before looking at why it
+    // was raised, so that a new one isn't lost.
+    w_sip(r_sip() & ~2);
+
+    ipiintr();
+
+    if(!timerfired(cpuid()))
+      return 1;
+
+    // run expired timers; was the scheduler tick due?
+    if(timerintr() == 0)
+      return 1;
 
     if(cpuid() == 0){
       clockintr();
     }
-    
-    // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
-    w_sip(r_sip() & ~2);
 
     return 2;
   } else {
@@ -0,0 +1,102 @@
+//
+// User-space profiler, like profil() in Unix.
+//
+// A process that calls uprof(n) has each child it creates
+// afterwards sampled every n ticks of that child's user
+// time: usertrap() records the child's user pc in the
+// parent's buffer, which the parent drains with uprofread().
+// Samples go to the parent, rather than into the child's
+// memory, so that the parent can profile programs it didn't
+// build and read the last samples after the child has exited.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "uprof.h"
+#include "defs.h"
+
+#define NUSAMPLE ((PGSIZE - 2*sizeof(uint)) / sizeof(struct usample))
+
+// a buffer of samples; fills one page.
+// wait_lock protects it, since children find it through
+// p->parent, which wait_lock also protects.
+struct uprofbuf {
+  uint head, tail;       // samples are at [tail, head)
+  struct usample s[NUSAMPLE];
+};
+
+extern struct spinlock wait_lock;
+
+// Called from usertrap() on each timer interrupt of a
+// process being sampled.
+void
+uprofsample(struct proc *p)
+{
+  struct uprofbuf *b;
+
+  if(++p->proftick < p->profticks)
+    return;
+  p->proftick = 0;
+
+  acquire(&wait_lock);
+  if(p->parent && (b = p->parent->prof) != 0 && b->head - b->tail < NUSAMPLE){
+    b->s[b->head % NUSAMPLE].pid = p->pid;
+    b->s[b->head % NUSAMPLE].pc = p->trapframe->epc;
+    b->head++;
+  }
+  release(&wait_lock);
+}
+
+// Sample children created from now on every n ticks,
+// or stop sampling new children if n is 0.
+int
+uprof(int n)
+{
+  struct proc *p = myproc();
+  struct uprofbuf *b;
+
+  if(n < 0)
+    return -1;
+  if(n > 0 && p->prof == 0){
+    if((b = (struct uprofbuf*)kalloc()) == 0)
+      return -1;
+    b->head = b->tail = 0;
+    acquire(&wait_lock);
+    p->prof = b;
+    release(&wait_lock);
+  }
+  p->profchildren = n;
+  return 0;
+}
+
+// Copy out and remove up to n samples.
+// Returns the number copied.
+int
+uprofread(uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct uprofbuf *b;
+  struct usample s;
+  int i;
+
+  acquire(&wait_lock);
+  if((b = p->prof) == 0){
+    release(&wait_lock);
+    return -1;
+  }
+  for(i = 0; i < n && b->tail != b->head; i++){
+    s = b->s[b->tail % NUSAMPLE];
+    b->tail++;
+    release(&wait_lock);
+    if(copyout(p->pagetable, addr + i*sizeof(s), (char*)&s, sizeof(s)) < 0)
+      return -1;
+    acquire(&wait_lock);
+  }
+  release(&wait_lock);
+  return i;
+}
@@ -0,0 +1,9 @@
+// Samples from the user profiler, read with uprofread();
+// see uprof.c.
+// Both the kernel and user programs use this header file.
+
+struct usample {
+  int pid;      // the child that was interrupted
+  int pad;
+  uint64 pc;    // its user pc
+};
@@ -0,0 +1,297 @@
+//
+// Asynchronous I/O rings, in the style of Linux's io_uring.
+//
+// uring_setup() maps a page holding a submission queue and
+// a completion queue into the process (struct uringbuf in
+// uring.h) and starts kernel threads to serve it. The process
+// fills in submission entries and calls uring_enter(), which
+// takes them all in one trap and queues them for the workers.
+// Each worker runs one operation at a time, in the process's
+// address space, and posts its result as a completion entry,
+// which the process can read without entering the kernel.
+// With several workers, several disk requests can be in
+// flight for one process.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "uring.h"
+#include "defs.h"
+
+// an operation taken from the submission queue.
+struct ureq {
+  int op;
+  int n;
+  struct file *f;       // for reads and writes; a reference of its own
+  struct inode *cwd;    // for opens; a reference of its own
+  uint64 addr;
+  int off;
+  uint64 data;
+};
+
+struct uring {
+  struct spinlock lock;
+  struct uringbuf *buf; // shared with the process
+  struct proc *owner;
+  uint sqhead;          // the kernel's copies of buf->sqhead
+  uint cqtail;          // and buf->cqtail
+  struct ureq q[NSQE];  // taken but not yet started, at [qhead, qtail)
+  uint qhead, qtail;
+  int busy;             // being run by workers
+  int nworker;          // workers that haven't exited
+};
+
+// post a completion. Caller holds r->lock.
+static void
+complete(struct uring *r, uint64 data, int res)
+{
+  struct cqe *c = &r->buf->cq[r->cqtail % NCQE];
+
+  c->data = data;
+  c->res = res;
+  r->cqtail++;
+  __sync_synchronize();  // the entry before the new tail.
+  r->buf->cqtail = r->cqtail;
+}
+
+// completions the process has yet to consume.
+static uint
+unconsumed(struct uring *r)
+{
+  return r->cqtail - *(volatile uint*)&r->buf->cqhead;
+}
+
+// carry out a request, as the system call would.
+static int
+perform(struct uring *r, struct ureq *rq)
+{
+  struct proc *p = myproc();
+  struct inode *cwd;
+  struct file *f;
+  char path[MAXPATH];
+  int res = -1;
+
+  switch(rq->op){
+  case UR_NOP:
+    res = 0;
+    break;
+  case UR_READ:
+    res = filereadat(rq->f, rq->addr, rq->n, rq->off);
+    break;
+  case UR_WRITE:
+    res = filewriteat(rq->f, rq->addr, rq->n, rq->off);
+    break;
+  case UR_OPEN:
+    // look up relative paths from the owner's cwd as of
+    // the submission.
+    cwd = p->cwd;
+    p->cwd = rq->cwd;
+    if(fetchstr(rq->addr, path, MAXPATH) >= 0 &&
+       (f = openfile(path, rq->n)) != 0){
+      if((res = fdallocproc(r->owner, f)) < 0)
+        fileclose(f);
+    }
+    p->cwd = cwd;
+    break;
+  }
+  return res;
+}
+
+// drop the references a request holds.
+static void
+putreq(struct ureq *rq)
+{
+  if(rq->f)
+    fileclose(rq->f);
+  if(rq->cwd){
+    begin_op();
+    iput(rq->cwd);
+    end_op();
+  }
+}
+
+// a worker thread, started by kthread().
+static void
+worker(void *arg)
+{
+  struct uring *r = arg;
+  struct proc *p = myproc();
+  struct ureq rq;
+  int res;
+
+  acquire(&r->lock);
+  for(;;){
+    while(r->qhead == r->qtail && !p->killed)
+      sleep(&r->qhead, &r->lock);
+    if(p->killed)
+      break;
+    rq = r->q[r->qhead % NSQE];
+    r->qhead++;
+    r->busy++;
+    release(&r->lock);
+
+    res = perform(r, &rq);
+    putreq(&rq);
+
+    acquire(&r->lock);
+    r->busy--;
+    complete(r, rq.data, res);
+    wakeup(r);
+  }
+  r->nworker--;
+  wakeup(r);
+  release(&r->lock);
+  exit(0);
+}
+
+// Set up rings for the current process, served by nworker
+// kernel threads. Returns the user address of its struct
+// uringbuf, or -1.
+uint64
+uringsetup(int nworker)
+{
+  struct proc *p = myproc();
+  struct uring *r;
+  int i;
+
+  // the workers serve one process's open files, so
+  // threads can't have rings of their own.
+  if(p->uring || p->group || nworker < 1 || nworker > MAXURINGWORKER)
+    return -1;
+
+  if((r = (struct uring*)kalloc()) == 0)
+    return -1;
+  memset(r, 0, sizeof(*r));
+  if((r->buf = (struct uringbuf*)kalloc()) == 0){
+    kfree(r);
+    return -1;
+  }
+  memset(r->buf, 0, PGSIZE);
+  if(mappages(p->pagetable, URING, PGSIZE, (uint64)r->buf,
+              PTE_R | PTE_W | PTE_U) < 0){
+    kfree(r->buf);
+    kfree(r);
+    return -1;
+  }
+  initlock(&r->lock, "uring");
+  r->owner = p;
+  p->uring = r;
+
+  for(i = 0; i < nworker; i++){
+    acquire(&r->lock);
+    r->nworker++;
+    release(&r->lock);
+    if(kthread(worker, r, "uring") < 0){
+      acquire(&r->lock);
+      r->nworker--;
+      release(&r->lock);
+      break;
+    }
+  }
+  if(i == 0){
+    uringfree(p);
+    return -1;
+  }
+  return URING;
+}
+
+// Take up to n entries from the submission queue, and then
+// wait until at least min completions are waiting for the
+// process, or none can arrive. Returns the number of entries
+// taken, or -1.
+int
+uringenter(int n, int min)
+{
+  struct proc *p = myproc();
+  struct uring *r = p->uring;
+  struct uringbuf *buf;
+  struct ureq *rq;
+  struct sqe e;
+  int fd, taken = 0;
+
+  if(r == 0)
+    return -1;
+  buf = r->buf;
+
+  acquire(&r->lock);
+  // stop short of anything that could overflow the
+  // completion queue.
+  while(taken < n && r->sqhead != *(volatile uint*)&buf->sqtail &&
+        unconsumed(r) + r->busy + (r->qtail - r->qhead) < NCQE){
+    __sync_synchronize();  // read the entry after the tail.
+    e = buf->sq[r->sqhead % NSQE];
+    r->sqhead++;
+    buf->sqhead = r->sqhead;
+    taken++;
+
+    rq = &r->q[r->qtail % NSQE];
+    memset(rq, 0, sizeof(*rq));
+    rq->op = e.op;
+    rq->n = e.n;
+    rq->addr = e.addr;
+    rq->off = e.off;
+    rq->data = e.data;
+    fd = e.fd;
+    switch(e.op){
+    case UR_NOP:
+      break;
+    case UR_READ:
+    case UR_WRITE:
+      if(fd >= 0 && fd < NOFILE){
+        acquire(&p->filelock);  // clone()'s threads share ofile[]
+        if((rq->f = p->ofile[fd]) != 0)
+          filedup(rq->f);
+        release(&p->filelock);
+      }
+      if(rq->f == 0){
+        complete(r, e.data, -1);
+        continue;
+      }
+      break;
+    case UR_OPEN:
+      rq->cwd = cwdget(p);
+      break;
+    default:
+      complete(r, e.data, -1);
+      continue;
+    }
+    r->qtail++;
+    wakeup(&r->qhead);
+  }
+
+  while(unconsumed(r) < min && r->busy + (r->qtail - r->qhead) > 0 &&
+        r->nworker > 0){
+    if(p->killed)
+      break;
+    sleep(r, &r->lock);
+  }
+  release(&r->lock);
+  return taken;
+}
+
+// Tear down the current process's rings, once its workers
+// have exited, for exit() and exec().
+void
+uringfree(struct proc *p)
+{
+  struct uring *r = p->uring;
+
+  // requests no worker got to.
+  while(r->qhead != r->qtail){
+    putreq(&r->q[r->qhead % NSQE]);
+    r->qhead++;
+  }
+  uvmunmap(p->pagetable, URING, 1, 0);
+  freelock(&r->lock);
+  kfree(r->buf);
+  kfree(r);
+  p->uring = 0;
+}
@@ -0,0 +1,45 @@
+// Asynchronous I/O rings, shared by a process and the
+// kernel; see uring.c.
+// Both the kernel and user programs use this header file.
+
+#define NSQE 64           // entries in the submission queue
+#define NCQE 64           // entries in the completion queue
+#define MAXURINGWORKER 8  // kernel threads per ring
+
+// operations
+#define UR_NOP   0
+#define UR_READ  1        // read(fd, addr, n), at off unless it is -1
+#define UR_WRITE 2        // write(fd, addr, n), at off unless it is -1
+#define UR_OPEN  3        // open(addr, n)
+
+// a submission queue entry, filled in by the process.
+struct sqe {
+  uchar op;               // UR_*
+  uchar pad[3];
+  int fd;
+  uint64 addr;
+  int n;
+  int off;
+  uint64 data;            // copied to the completion
+};
+
+// a completion queue entry, filled in by the kernel.
+struct cqe {
+  uint64 data;            // from the sqe
+  int res;                // what the system call would have returned
+  int pad;
+};
+
+// the page mapped at the address uring_setup() returns.
+// The process adds entries at sq[sqtail % NSQE] and then
+// advances sqtail, and the kernel advances sqhead as it takes
+// them. The kernel adds completions at cq[cqtail % NCQE],
+// and the process advances cqhead as it consumes them.
+struct uringbuf {
+  uint sqhead;
+  uint sqtail;
+  uint cqhead;
+  uint cqtail;
+  struct sqe sq[NSQE];
+  struct cqe cq[NCQE];
+};
@@ -16,6 +16,10 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "trace.h"
+#include "time.h"
+#include "bcstat.h"
+#include "iostat.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -38,11 +42,20 @@ static struct disk {
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b[NBIOVEC];  // consecutive blocks
+    int nb;
     char status;
+    char write;
+    char async;    // no one waits: hand each b to bdone()
+    uint64 start;  // readtime() when submitted
   } info[NUM];
+
+  // the request headers, indexed like info[], since an
+  // asynchronous request outlives its submitter's stack.
+  struct virtio_blk_outhdr ops[NUM];
   
   struct spinlock vdisk_lock;
+  struct diskstat st;
   
 } __attribute__ ((aligned (PGSIZE))) disk;
 
@@ -99,7 +112,7 @@ virtio_disk_init(void)
   *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
 
   // desc = pages -- num * VRingDesc
-  // avail = pages + 0x40 -- 2 * uint16, then num * uint16
+  // avail = pages + num * VRingDesc -- 2 * uint16, then num * uint16
   // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
 
   disk.desc = (struct VRingDesc *) disk.pages;
@@ -151,10 +164,11 @@ free_chain(int i)
   }
 }
 
+// allocate n descriptors, or none.
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -165,67 +179,73 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// format the descriptors of a request for the nb buffers in
+// b, which hold consecutive blocks, and hand them to the
+// device. Caller holds disk.vdisk_lock.
+static void
+submit(struct buf **b, int nb, int write, int *idx, int async)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  uint64 sector = b[0]->blockno * (BSIZE / 512);
+  int i, d;
 
-  acquire(&disk.vdisk_lock);
-
-  // the spec says that legacy block operations use three
-  // descriptors: one for type/reserved/sector, one for
-  // the data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-  
-  // format the three descriptors.
+  // the spec says that legacy block operations use a
+  // descriptor for type/reserved/sector, then descriptors
+  // for the data, which may be scattered, then one for a
+  // 1-byte status result.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_outhdr {
-    uint32 type;
-    uint32 reserved;
-    uint64 sector;
-  } buf0;
+  struct virtio_blk_outhdr *buf0 = &disk.ops[idx[0]];
 
   if(write)
-    buf0.type = VIRTIO_BLK_T_OUT; // write the disk
+    buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
-    buf0.type = VIRTIO_BLK_T_IN; // read the disk
-  buf0.reserved = 0;
-  buf0.sector = sector;
-
-  // buf0 is on a kernel stack, which is not direct mapped,
-  // thus the call to kvmpa().
-  disk.desc[idx[0]].addr = (uint64) kvmpa((uint64) &buf0);
-  disk.desc[idx[0]].len = sizeof(buf0);
+    buf0->type = VIRTIO_BLK_T_IN; // read the disk
+  buf0->reserved = 0;
+  buf0->sector = sector;
+
+  disk.desc[idx[0]].addr = (uint64) buf0;
+  disk.desc[idx[0]].len = sizeof(*buf0);
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(i = 0; i < nb; i++){
+    d = idx[1+i];
+    disk.desc[d].addr = (uint64) b[i]->data;
+    disk.desc[d].len = BSIZE;
+    if(write)
+      disk.desc[d].flags = 0; // device reads b->data
+    else
+      disk.desc[d].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[d].flags |= VRING_DESC_F_NEXT;
+    disk.desc[d].next = idx[2+i];
+  }
 
+  d = idx[1+nb];
   disk.info[idx[0]].status = 0;
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  disk.desc[d].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[d].len = 1;
+  disk.desc[d].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[d].next = 0;
+
+  // record struct bufs for virtio_disk_intr().
+  for(i = 0; i < nb; i++){
+    b[i]->disk = 1;
+    disk.info[idx[0]].b[i] = b[i];
+  }
+  disk.info[idx[0]].nb = nb;
+  disk.info[idx[0]].write = write;
+  disk.info[idx[0]].async = async;
+  disk.info[idx[0]].start = readtime();
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  if(write)
+    disk.st.nwrite++;
+  else
+    disk.st.nread++;
+  disk.st.nblk += nb;
+  disk.st.depth++;
+  if(disk.st.depth > disk.st.maxdepth)
+    disk.st.maxdepth = disk.st.depth;
+  disk.st.depthsum += disk.st.depth;
 
   // avail[0] is flags
   // avail[1] tells the device how far to look in avail[2...].
@@ -236,21 +256,83 @@ virtio_disk_rw(struct buf *b, int write)
   disk.avail[1] = disk.avail[1] + 1;
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  trace(TE_DISK_SUBMIT, b[0]->blockno, write);
+}
+
+// Read or write the nb (at most NBIOVEC) buffers in b, which
+// hold consecutive blocks, with one request.
+void
+virtio_disk_rwv(struct buf **b, int nb, int write)
+{
+  int idx[NBIOVEC+2];
+
+  if(nb < 1 || nb > NBIOVEC)
+    panic("virtio_disk_rwv");
+
+  acquire(&disk.vdisk_lock);
+
+  // allocate the descriptors.
+  while(1){
+    if(alloc_descs(idx, nb+2) == 0) {
+      break;
+    }
+    sleep(&disk.free[0], &disk.vdisk_lock);
+  }
+
+  submit(b, nb, write, idx, 0);
 
   // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+  while(b[0]->disk == 1) {
+    sleep(b[0], &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
+  disk.info[idx[0]].nb = 0;
   free_chain(idx[0]);
 
   release(&disk.vdisk_lock);
 }
 
+// Start reading or writing the nb buffers in b, as for
+// virtio_disk_rwv(), without waiting for the disk;
+// virtio_disk_intr() passes each to bdone() once it is done.
+// Returns -1, having done nothing, if the queue is full.
+int
+virtio_disk_start(struct buf **b, int nb, int write)
+{
+  int idx[NBIOVEC+2];
+
+  if(nb < 1 || nb > NBIOVEC)
+    panic("virtio_disk_start");
+
+  acquire(&disk.vdisk_lock);
+  if(alloc_descs(idx, nb+2) < 0){
+    release(&disk.vdisk_lock);
+    return -1;
+  }
+  submit(b, nb, write, idx, 1);
+  release(&disk.vdisk_lock);
+  return 0;
+}
+
+// note a request's latency. Caller holds disk.vdisk_lock.
+static void
+account(uint64 cycles)
+{
+  uint64 ns = cycles * (NSEC_PER_SEC / CLINT_FREQ);
+  int b;
+
+  for(b = 0; b < NIOHIST-1 && (ns >> (b+1)) != 0; b++)
+    ;
+  disk.st.depth--;
+  disk.st.ns += ns;
+  disk.st.hist[b]++;
+}
+
 void
 virtio_disk_intr()
 {
+  int i, nb;
+
   acquire(&disk.vdisk_lock);
 
   while((disk.used_idx % NUM) != (disk.used->id % NUM)){
@@ -259,8 +341,20 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
     
-    disk.info[id].b->disk = 0;   // disk is done with buf
-    wakeup(disk.info[id].b);
+    nb = disk.info[id].nb;
+    trace(TE_DISK_DONE, disk.info[id].b[0]->blockno, disk.info[id].write);
+    account(readtime() - disk.info[id].start);
+    for(i = 0; i < nb; i++)
+      disk.info[id].b[i]->disk = 0;   // disk is done with buf
+    if(disk.info[id].async){
+      // no one is waiting to free the descriptors.
+      disk.info[id].nb = 0;
+      free_chain(id);
+      for(i = 0; i < nb; i++)
+        bdone(disk.info[id].b[i]);
+    } else {
+      wakeup(disk.info[id].b[0]);
+    }
 
     disk.used_idx = (disk.used_idx + 1) % NUM;
   }
@@ -268,3 +362,12 @@ virtio_disk_intr()
 
   release(&disk.vdisk_lock);
 }
+
+// Report the disk's counts.
+void
+virtio_disk_stat(struct diskstat *st)
+{
+  acquire(&disk.vdisk_lock);
+  *st = disk.st;
+  release(&disk.vdisk_lock);
+}
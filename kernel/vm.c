@@ -351,8 +351,8 @@ uvmclear(pagetable_t pagetable, uint64 va)
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
-int
-copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
+static int
+copyout1(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
 
@@ -373,11 +373,23 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
   return 0;
 }
 
+// copyout1(), counted so that a sibling thread's sbrk() can't
+// free the pages it is copying; see vmwalkbegin().
+int
+copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
+{
+  struct proc *g = vmwalkbegin(pagetable);
+  int r = copyout1(pagetable, dstva, src, len);
+
+  vmwalkend(g);
+  return r;
+}
+
 // Copy from user to kernel.
 // Copy len bytes to dst from virtual address srcva in a given page table.
 // Return 0 on success, -1 on error.
-int
-copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
+static int
+copyin1(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
 
@@ -398,12 +410,24 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
   return 0;
 }
 
+// copyin1(), counted so that a sibling thread's sbrk() can't
+// free the pages it is copying; see vmwalkbegin().
+int
+copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
+{
+  struct proc *g = vmwalkbegin(pagetable);
+  int r = copyin1(pagetable, dst, srcva, len);
+
+  vmwalkend(g);
+  return r;
+}
+
 // Copy a null-terminated string from user to kernel.
 // Copy bytes to dst from virtual address srcva in a given page table,
 // until a '\0', or max.
 // Return 0 on success, -1 on error.
-int
-copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
+static int
+copyinstr1(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
   uint64 n, va0, pa0;
   int got_null = 0;
@@ -440,3 +464,15 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
     return -1;
   }
 }
+
+// copyinstr1(), counted so that a sibling thread's sbrk() can't
+// free the pages it is copying; see vmwalkbegin().
+int
+copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
+{
+  struct proc *g = vmwalkbegin(pagetable);
+  int r = copyinstr1(pagetable, dst, srcva, max);
+
+  vmwalkend(g);
+  return r;
+}
@@ -0,0 +1 @@
+#define WNOHANG   0x001  // waitpid: don't block if no child has exited
@@ -0,0 +1,192 @@
+//
+// Timer wheel, for timeouts measured in scheduler ticks.
+//
+// A hierarchical wheel: WLEVELS levels of WSLOTS slots each.
+// A timer due within WSLOTS ticks sits in level 0, in the slot
+// for its deadline; one due within WSLOTS^2 ticks sits in
+// level 1, in the slot for its deadline / WSLOTS, and so on.
+// Each tick, wheeltick() runs the timers in one level-0 slot,
+// and every WSLOTS ticks it first moves ("cascades") the next
+// level-1 slot's timers down into level 0, and so on upwards.
+// So adding, removing and expiring a timer are all O(1),
+// and a tick only touches timers that are due.
+//
+// Timers that run from the wheel are called from clockintr()
+// on CPU 0 with wheel.lock held, like those in timer.c.
+//
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "timer.h"
+#include "defs.h"
+
+#define WBITS    6
+#define WSLOTS   (1 << WBITS)
+#define WMASK    (WSLOTS - 1)
+#define WLEVELS  4
+#define WMAX     ((1L << (WBITS * WLEVELS)) - 1)  // furthest deadline
+
+struct {
+  struct spinlock lock;
+  uint64 now;  // ticks processed by wheeltick()
+  struct wtimer *slot[WLEVELS][WSLOTS];
+} wheel;
+
+void
+wheelinit(void)
+{
+  initlock(&wheel.lock, "wheel");
+}
+
+// put t into the slot for t->when, which is no earlier
+// than wheel.now. caller holds wheel.lock.
+static void
+place(struct wtimer *t)
+{
+  struct wtimer **head;
+  uint64 delta;
+  int level;
+
+  if(t->when - wheel.now > WMAX)
+    t->when = wheel.now + WMAX;
+  delta = t->when - wheel.now;
+  for(level = 0; level < WLEVELS-1; level++)
+    if(delta < (1L << (WBITS * (level+1))))
+      break;
+  head = &wheel.slot[level][(t->when >> (WBITS * level)) & WMASK];
+
+  t->next = *head;
+  if(*head)
+    (*head)->pprev = &t->next;
+  t->pprev = head;
+  *head = t;
+}
+
+static void
+unlink(struct wtimer *t)
+{
+  if(t->next)
+    t->next->pprev = t->pprev;
+  *t->pprev = t->next;
+  t->next = 0;
+  t->pprev = 0;
+}
+
+// Arrange for fn(t) to be called at tick when.
+// caller holds wheel.lock, see wheellock().
+void
+wheeladd(struct wtimer *t, uint64 when, void (*fn)(struct wtimer*), void *arg)
+{
+  if(!holding(&wheel.lock))
+    panic("wheeladd");
+  // this tick's slot has already run.
+  if(when <= wheel.now)
+    when = wheel.now + 1;
+  t->when = when;
+  t->fn = fn;
+  t->arg = arg;
+  place(t);
+}
+
+// Remove t if it hasn't fired yet.
+// Returns 1 if it was pending, 0 if it has fired.
+// caller holds wheel.lock.
+int
+wheeldel(struct wtimer *t)
+{
+  if(!holding(&wheel.lock))
+    panic("wheeldel");
+  if(t->pprev == 0)
+    return 0;
+  unlink(t);
+  return 1;
+}
+
+void
+wheellock(void)
+{
+  acquire(&wheel.lock);
+}
+
+void
+wheelunlock(void)
+{
+  release(&wheel.lock);
+}
+
+// current tick, as the wheel sees it.
+// caller holds wheel.lock.
+uint64
+wheelnow(void)
+{
+  return wheel.now;
+}
+
+// move the timers in slot (level, i) down to the levels below.
+static void
+cascade(int level, int i)
+{
+  struct wtimer *t;
+
+  while((t = wheel.slot[level][i]) != 0){
+    unlink(t);
+    place(t);
+  }
+}
+
+// Called by clockintr() once per tick.
+// Runs the timers that are now due.
+void
+wheeltick(void)
+{
+  struct wtimer *t;
+  int level, i;
+
+  acquire(&wheel.lock);
+  wheel.now++;
+  for(level = 1; level < WLEVELS; level++){
+    if((wheel.now & ((1L << (WBITS * level)) - 1)) != 0)
+      break;
+    cascade(level, (wheel.now >> (WBITS * level)) & WMASK);
+  }
+  i = wheel.now & WMASK;
+  while((t = wheel.slot[0][i]) != 0){
+    unlink(t);
+    t->fn(t);
+  }
+  release(&wheel.lock);
+}
+
+static void
+wheelwakeup(struct wtimer *t)
+{
+  wakeup(t);
+}
+
+// Sleep for n ticks.
+// Returns -1 if killed first.
+int
+sleepticks(int n)
+{
+  struct wtimer t;
+  struct proc *p = myproc();
+
+  if(n <= 0)
+    return 0;
+  acquire(&wheel.lock);
+  wheeladd(&t, wheel.now + n, wheelwakeup, p);
+  while(t.pprev != 0){
+    if(p->killed){
+      unlink(&t);
+      release(&wheel.lock);
+      return -1;
+    }
+    sleep(&t, &wheel.lock);
+  }
+  release(&wheel.lock);
+  return 0;
+}
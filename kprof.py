@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+#
+# Turn the output of xv6's user/kprof into folded stacks, one
+# line per distinct stack with its sample count, as read by
+# flamegraph.pl and speedscope:
+#
+#   make qemu | tee console.log     # and run: kprof usertests ...
+#   ./kprof.py console.log > kprof.folded
+#   flamegraph.pl kprof.folded > kprof.svg
+#
+# Kernel addresses are looked up in kernel/kernel.sym, and user
+# addresses in user/<name>.sym for the sampled process's name.
+
+import argparse
+import bisect
+import collections
+import os
+import sys
+
+class Symbols:
+    def __init__(self, path):
+        syms = {}
+        with open(path) as f:
+            for line in f:
+                parts = line.split()
+                if len(parts) != 2 or parts[1].startswith('.'):
+                    continue
+                try:
+                    addr = int(parts[0], 16)
+                except ValueError:
+                    continue
+                # keep one name per address; prefer function-like ones
+                if addr not in syms or syms[addr].startswith('$'):
+                    syms[addr] = parts[1]
+        self.addrs = sorted(syms)
+        self.names = [syms[a] for a in self.addrs]
+
+    def lookup(self, pc):
+        i = bisect.bisect_right(self.addrs, pc) - 1
+        if i < 0:
+            return '0x%x' % pc
+        return self.names[i]
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('logs', nargs='*', help='console output (default stdin)')
+    ap.add_argument('-k', '--kernel', default='kernel/kernel.sym',
+                    help='kernel symbol file')
+    ap.add_argument('-u', '--user', default='user',
+                    help='directory with the user programs\' .sym files')
+    ap.add_argument('--no-user', action='store_true',
+                    help='drop samples taken in user space')
+    args = ap.parse_args()
+
+    ksyms = Symbols(args.kernel)
+    usyms = {}
+    def user_symbols(name):
+        if name not in usyms:
+            path = os.path.join(args.user, name + '.sym')
+            usyms[name] = Symbols(path) if os.path.exists(path) else None
+        return usyms[name]
+
+    stacks = collections.Counter()
+    files = [open(p) for p in args.logs] or [sys.stdin]
+    for f in files:
+        for line in f:
+            i = line.find('kprof: ')
+            if i < 0:
+                continue
+            fields = line[i:].split()[1:]
+            if len(fields) < 5 or fields[3] not in ('k', 'u'):
+                continue
+            name, mode = fields[2], fields[3]
+            pcs = [int(x, 16) for x in fields[4:]]
+            if mode == 'u':
+                if args.no_user:
+                    continue
+                syms = user_symbols(name)
+                frames = [syms.lookup(pc) if syms else '0x%x' % pc for pc in pcs]
+            else:
+                frames = [ksyms.lookup(pc) + '_[k]' for pc in pcs]
+            root = name if name != '-' else 'idle'
+            stacks[';'.join([root] + frames[::-1])] += 1
+
+    for stack, n in sorted(stacks.items()):
+        print('%s %d' % (stack, n))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+#
+# Turn the output of xv6's user/ktrace into a Chrome trace, as
+# read by chrome://tracing and ui.perfetto.dev:
+#
+#   make qemu | tee console.log     # and run: ktrace usertests ...
+#   ./ktrace.py console.log > ktrace.json
+#
+# Each hart gets a track showing which process it ran, and each
+# process a track with its system calls, file system operations
+# and log commits. Sleeps, wakeups and buffer cache lookups are
+# instant events, and disk requests are async spans.
+
+import argparse
+import json
+import re
+import sys
+
+CLINT_FREQ = 10000000   # mtime cycles per second; see kernel/timer.c
+
+(TE_RUN, TE_STOP, TE_SLEEP, TE_WAKEUP, TE_BEGIN_OP, TE_END_OP,
+ TE_COMMIT, TE_COMMITTED, TE_BGET_HIT, TE_BGET_MISS,
+ TE_DISK_SUBMIT, TE_DISK_DONE, TE_SYSCALL, TE_SYSRET) = range(1, 15)
+
+STATES = ['unused', 'used', 'sleeping', 'runnable', 'running', 'zombie']
+
+def syscall_names(path):
+    names = {}
+    try:
+        with open(path) as f:
+            for line in f:
+                m = re.match(r'#define\s+SYS_(\w+)\s+(\d+)', line)
+                if m:
+                    names[int(m.group(2))] = m.group(1)
+    except OSError:
+        pass
+    return names
+
+def signed(x):
+    return x - (1 << 64) if x >= (1 << 63) else x
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('logs', nargs='*', help='console output (default stdin)')
+    ap.add_argument('-s', '--syscalls', default='kernel/syscall.h',
+                    help='header with the system call numbers')
+    args = ap.parse_args()
+
+    sysname = syscall_names(args.syscalls)
+    events = []
+    files = [open(p) for p in args.logs] or [sys.stdin]
+    for f in files:
+        for line in f:
+            i = line.find('ktrace: ')
+            if i < 0:
+                continue
+            fields = line[i:].split()[1:]
+            if len(fields) != 6:
+                continue
+            try:
+                events.append([int(x) for x in fields])
+            except ValueError:
+                continue
+    # each hart's ring is drained separately, so merge by time.
+    events.sort(key=lambda e: e[0])
+
+    out = []
+    harts = set()
+    pids = set()
+    t0 = events[0][0] if events else 0
+    for time, hart, pid, type, arg0, arg1 in events:
+        ts = (time - t0) * 1e6 / CLINT_FREQ
+        harts.add(hart)
+        if pid:
+            pids.add(pid)
+        # events outside any process go on their hart's track.
+        ev = {'ts': ts, 'pid': pid, 'tid': pid if pid else hart}
+        if type == TE_RUN:
+            ev.update(name='pid %d' % pid, ph='B', pid=0, tid=hart)
+        elif type == TE_STOP:
+            state = STATES[arg0] if arg0 < len(STATES) else str(arg0)
+            ev.update(name='pid %d' % pid, ph='E', pid=0, tid=hart,
+                      args={'state': state})
+        elif type == TE_SLEEP:
+            ev.update(name='sleep', ph='i', s='t', args={'chan': hex(arg0)})
+        elif type == TE_WAKEUP:
+            ev.update(name='wakeup %d' % arg1, ph='i', s='t',
+                      args={'chan': hex(arg0), 'pid': arg1})
+        elif type == TE_BEGIN_OP:
+            ev.update(name='op', ph='B')
+        elif type == TE_END_OP:
+            ev.update(name='op', ph='E')
+        elif type == TE_COMMIT:
+            ev.update(name='commit', ph='B', args={'blocks': arg0})
+        elif type == TE_COMMITTED:
+            ev.update(name='commit', ph='E')
+        elif type in (TE_BGET_HIT, TE_BGET_MISS):
+            hit = 'hit' if type == TE_BGET_HIT else 'miss'
+            ev.update(name='bget ' + hit, ph='i', s='t',
+                      args={'dev': arg0, 'blockno': arg1})
+        elif type in (TE_DISK_SUBMIT, TE_DISK_DONE):
+            # the interrupt may arrive on any hart in any process,
+            # so put requests on their own track, keyed by block.
+            ev.update(name='write' if arg1 else 'read', cat='disk',
+                      ph='b' if type == TE_DISK_SUBMIT else 'e',
+                      id=arg0, pid=-1, tid=0, args={'blockno': arg0})
+        elif type == TE_SYSCALL:
+            ev.update(name=sysname.get(arg0, 'syscall %d' % arg0), ph='B')
+        elif type == TE_SYSRET:
+            ev.update(name=sysname.get(arg0, 'syscall %d' % arg0), ph='E',
+                      args={'ret': signed(arg1)})
+        else:
+            continue
+        out.append(ev)
+
+    meta = [{'name': 'process_name', 'ph': 'M', 'pid': 0,
+             'args': {'name': 'harts'}},
+            {'name': 'process_name', 'ph': 'M', 'pid': -1,
+             'args': {'name': 'disk'}}]
+    for h in sorted(harts):
+        meta.append({'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': h,
+                     'args': {'name': 'hart %d' % h}})
+    for p in sorted(pids):
+        meta.append({'name': 'process_name', 'ph': 'M', 'pid': p,
+                     'args': {'name': 'pid %d' % p}})
+    json.dump({'traceEvents': meta + out, 'displayTimeUnit': 'ns'},
+              sys.stdout)
+    print()
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,151 @@
+// Mix small-file lookups, whose directory, inode and data
+// blocks are hot, with streaming reads of a file bigger than
+// the cache, under each replacement policy, and count the hot
+// blocks' misses after each stream. Under LRU every stream
+// pushes them out; 2Q should keep them.
+// usage: bcachemix [maxbuf]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/time.h"
+#include "kernel/bcstat.h"
+#include "user/user.h"
+
+#define NHOT   16    // small files
+#define NROUND 5     // streams, each followed by a hot pass
+
+char *dir = "bcachemix.d";
+char *big = "bcachemix.d/big";
+char buf[BSIZE];
+
+uint64
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+char*
+hotname(int i)
+{
+  static char name[] = "bcachemix.d/hot?";
+
+  name[sizeof(name)-2] = 'a' + i;
+  return name;
+}
+
+void
+create(char *name, int nblk)
+{
+  int fd, i;
+
+  if((fd = open(name, O_CREATE|O_WRONLY)) < 0){
+    fprintf(2, "bcachemix: cannot create %s\n", name);
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < nblk; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "bcachemix: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+// read a file through; returns how many bytes.
+int
+readall(char *name)
+{
+  int fd, n, tot = 0;
+
+  if((fd = open(name, O_RDONLY)) < 0){
+    fprintf(2, "bcachemix: cannot open %s\n", name);
+    exit(1);
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    tot += n;
+  close(fd);
+  return tot;
+}
+
+void
+hotpass(void)
+{
+  int i;
+
+  for(i = 0; i < NHOT; i++)
+    readall(hotname(i));
+}
+
+uint64
+misses(void)
+{
+  struct bcstat st;
+
+  bcstat(&st);
+  return st.nmiss;
+}
+
+void
+run(int policy, int maxbuf)
+{
+  uint64 t, m, bytes = 0;
+  int i;
+
+  if(bcctl(policy, maxbuf) < 0){
+    fprintf(2, "bcachemix: bcctl failed\n");
+    exit(1);
+  }
+  printf("%s: hot misses after each stream:", policy == BC_2Q ? "2q " : "lru");
+  for(i = 0; i < 3; i++)
+    hotpass();
+  t = 0;
+  for(i = 0; i < NROUND; i++){
+    t -= now();
+    bytes += readall(big);
+    t += now();
+    m = misses();
+    hotpass();
+    printf(" %l", misses() - m);
+  }
+  printf(", streamed %l KB/s\n", t ? bytes * 1000000 / t : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bcstat st;
+  int i, maxbuf = 160;
+
+  if(argc > 1)
+    maxbuf = atoi(argv[1]);
+  bcstat(&st);
+  if(maxbuf >= MAXFILE){
+    fprintf(2, "bcachemix: the cache must hold fewer than %d blocks\n", MAXFILE);
+    exit(1);
+  }
+
+  if(mkdir(dir) < 0){
+    fprintf(2, "bcachemix: cannot make %s\n", dir);
+    exit(1);
+  }
+  for(i = 0; i < NHOT; i++)
+    create(hotname(i), 1);
+  create(big, MAXFILE);
+  printf("bcachemix: %d hot files, a %d KB stream, %d buffers\n",
+         NHOT, MAXFILE * BSIZE / 1024, maxbuf);
+
+  run(BC_LRU, maxbuf);
+  run(BC_2Q, maxbuf);
+  bcctl(st.policy, st.maxbuf);
+
+  for(i = 0; i < NHOT; i++)
+    unlink(hotname(i));
+  unlink(big);
+  unlink(dir);
+  exit(0);
+}
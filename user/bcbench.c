@@ -0,0 +1,117 @@
+// Measure buffer cache contention: NCHILD processes each read
+// a file of their own, over and over, at the same time. The
+// files are small enough that the blocks stay cached, so the
+// time goes to bget() and brelse(), not the disk.
+// Reports the elapsed time and how often the bcache locks
+// made a hart wait, from the lockstat device.
+// usage: bcbench [nchild]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/time.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define NBLK   4     // blocks per file
+#define NPASS  200   // times each child reads its file
+
+char buf[BSIZE];
+struct lockstat st[64];
+
+uint64
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+void
+name(char *s, int i)
+{
+  strcpy(s, "bcb.0");
+  s[4] = '0' + i;
+}
+
+void
+reader(int i)
+{
+  char file[8];
+  int fd, pass;
+
+  name(file, i);
+  for(pass = 0; pass < NPASS; pass++){
+    if((fd = open(file, O_RDONLY)) < 0){
+      fprintf(2, "bcbench: open %s failed\n", file);
+      exit(1);
+    }
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char file[8];
+  int i, j, fd, n, nchild = 4;
+  uint64 t0, t, waits, acquires;
+
+  if(argc > 1)
+    nchild = atoi(argv[1]);
+  if(nchild < 1 || nchild > 10){
+    fprintf(2, "usage: bcbench [nchild], at most 10\n");
+    exit(1);
+  }
+
+  for(i = 0; i < nchild; i++){
+    name(file, i);
+    if((fd = open(file, O_CREATE|O_WRONLY)) < 0){
+      fprintf(2, "bcbench: create %s failed\n", file);
+      exit(1);
+    }
+    memset(buf, 'a' + i, sizeof(buf));
+    for(j = 0; j < NBLK; j++)
+      write(fd, buf, sizeof(buf));
+    close(fd);
+  }
+
+  fd = open("lockstat", O_RDWR);
+  if(fd >= 0)
+    write(fd, "0", 1);
+  t0 = now();
+  for(i = 0; i < nchild; i++){
+    if(fork() == 0)
+      reader(i);
+  }
+  for(i = 0; i < nchild; i++)
+    wait(0);
+  t = now() - t0;
+
+  printf("bcbench: %d readers, %d reads each: %l ms\n",
+         nchild, NPASS * NBLK, t / 1000000);
+  if(fd >= 0){
+    waits = acquires = 0;
+    n = read(fd, st, sizeof(st)) / sizeof(st[0]);
+    for(i = 0; i < n; i++){
+      if(strcmp(st[i].name, "bcache") == 0 ||
+         strcmp(st[i].name, "bcache.bucket") == 0){
+        acquires += st[i].nacquire;
+        waits += st[i].ncontend;
+      }
+    }
+    printf("bcbench: bcache locks acquired %l times, waited %l times\n",
+           acquires, waits);
+    close(fd);
+  }
+
+  for(i = 0; i < nchild; i++){
+    name(file, i);
+    unlink(file);
+  }
+  exit(0);
+}
@@ -0,0 +1,68 @@
+// Show the buffer cache's size and hit rate, since boot or
+// while a command runs. -p sets the replacement policy, lru
+// or 2q, and -m the most buffers the cache may hold.
+// usage: bcstat [-p policy] [-m maxbuf] [command args...]
+
+#include "kernel/types.h"
+#include "kernel/wait.h"
+#include "kernel/fs.h"
+#include "kernel/bcstat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct bcstat before, after;
+  uint64 hit, miss, req, blk;
+  int pid, policy = -1, maxbuf = -1;
+  char **cmd = argv + 1;
+
+  for(; cmd[0] && cmd[1] && cmd[0][0] == '-'; cmd += 2){
+    if(strcmp(cmd[0], "-p") == 0 && strcmp(cmd[1], "lru") == 0)
+      policy = BC_LRU;
+    else if(strcmp(cmd[0], "-p") == 0 && strcmp(cmd[1], "2q") == 0)
+      policy = BC_2Q;
+    else if(strcmp(cmd[0], "-m") == 0)
+      maxbuf = atoi(cmd[1]);
+    else
+      break;
+  }
+  if(*cmd && cmd[0][0] == '-'){
+    fprintf(2, "usage: bcstat [-p lru|2q] [-m maxbuf] [command args...]\n");
+    exit(1);
+  }
+  if((policy != -1 || maxbuf != -1) && bcctl(policy, maxbuf) < 0){
+    fprintf(2, "bcstat: bcctl failed\n");
+    exit(1);
+  }
+
+  memset(&before, 0, sizeof(before));
+  if(*cmd){
+    bcstat(&before);
+    if((pid = spawn(cmd[0], cmd, 0, 0)) < 0){
+      fprintf(2, "bcstat: exec %s failed\n", cmd[0]);
+      exit(1);
+    }
+    waitpid(pid, 0, 0);
+  }
+  if(bcstat(&after) < 0){
+    fprintf(2, "bcstat: bcstat failed\n");
+    exit(1);
+  }
+
+  hit = after.nhit - before.nhit;
+  miss = after.nmiss - before.nmiss;
+  printf("bcache: %s, %d buffers (%d KB) of at most %d, %l pages added, %l given back\n",
+         after.policy == BC_2Q ? "2q" : "lru",
+         after.nbuf, after.nbuf * BSIZE / 1024, after.maxbuf,
+         after.ngrow - before.ngrow, after.nshrink - before.nshrink);
+  printf("bcache: %l hits, %l misses, %l%% hit rate\n", hit, miss,
+         hit + miss ? hit * 100 / (hit + miss) : 0);
+  printf("bcache: %l blocks read ahead, %l of them used\n",
+         after.nahead - before.nahead, after.nahit - before.nahit);
+  req = after.nreq - before.nreq;
+  blk = after.nreqblk - before.nreqblk;
+  printf("bcache: %l disk requests, %l per MB\n", req,
+         blk ? req * (1024*1024/BSIZE) / blk : 0);
+  exit(0);
+}
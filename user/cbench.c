@@ -0,0 +1,116 @@
+// Time nproc processes each creating nfile small files at
+// once, and count the log commits they took: with group
+// commit, many creates should share one. With no arguments,
+// it runs with 1, 2, 4 and 8 processes.
+// usage: cbench [nproc [nfile]]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/time.h"
+#include "kernel/bcstat.h"
+#include "kernel/iostat.h"
+#include "user/user.h"
+
+#define MAXPROC 26
+
+char data[64];
+
+uint64
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+char*
+name(int p, int i)
+{
+  static char buf[] = "cb??.tmp";
+
+  buf[2] = 'a' + p;
+  buf[3] = '0' + i % 64;
+  return buf;
+}
+
+void
+child(int p, int nfile)
+{
+  int fd, i;
+
+  memset(data, 'a' + p, sizeof(data));
+  for(i = 0; i < nfile; i++){
+    if((fd = open(name(p, i), O_CREATE|O_WRONLY)) < 0){
+      fprintf(2, "cbench: cannot create %s\n", name(p, i));
+      exit(1);
+    }
+    if(write(fd, data, sizeof(data)) != sizeof(data)){
+      fprintf(2, "cbench: write failed\n");
+      exit(1);
+    }
+    close(fd);
+  }
+  exit(0);
+}
+
+void
+run(int nproc, int nfile)
+{
+  struct iostat before, after;
+  uint64 t, commit, nfiles = nproc * nfile;
+  int p, i, st, fail = 0;
+
+  iostat(&before);
+  t = now();
+  for(p = 0; p < nproc; p++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "cbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      child(p, nfile);
+  }
+  for(p = 0; p < nproc; p++){
+    wait(&st);
+    if(st != 0)
+      fail = 1;
+  }
+  t = now() - t;
+  iostat(&after);
+  if(fail)
+    exit(1);
+
+  commit = after.log.ncommit - before.log.ncommit;
+  printf("%d procs: %l files in %l us, %l files/s, %l commits, "
+         "%l blocks and %l files per commit, %l waits\n",
+         nproc, nfiles, t / 1000, t ? nfiles * 1000000000 / t : 0, commit,
+         commit ? (after.log.nblk - before.log.nblk) / commit : 0,
+         commit ? nfiles / commit : 0, after.log.nwait - before.log.nwait);
+
+  for(p = 0; p < nproc; p++)
+    for(i = 0; i < nfile; i++)
+      unlink(name(p, i));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, nfile = 20;
+
+  if(argc > 2)
+    nfile = atoi(argv[2]);
+  if(argc > 1){
+    nproc = atoi(argv[1]);
+    if(nproc < 1 || nproc > MAXPROC || nfile < 1 || nfile > 64){
+      fprintf(2, "usage: cbench [nproc [nfile]]\n");
+      exit(1);
+    }
+    run(nproc, nfile);
+    exit(0);
+  }
+  for(nproc = 1; nproc <= 8; nproc *= 2)
+    run(nproc, nfile);
+  exit(0);
+}
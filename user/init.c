@@ -23,6 +23,12 @@ main(void)
   dup(0);  // stdout
   dup(0);  // stderr
 
+  // devices for the profiler, tracer and lock statistics;
+  // mknod fails harmlessly if they exist.
+  mknod("kprof", KPROF, 0);
+  mknod("ktrace", KTRACE, 0);
+  mknod("lockstat", LOCKSTAT, 0);
+
   for(;;){
     printf("init: starting sh\n");
     pid = fork();
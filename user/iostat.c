@@ -0,0 +1,134 @@
+// Sample the storage statistics every interval seconds, and
+// print what changed: buffer cache hits, misses, recycled
+// buffers and read-ahead blocks used; log commits, blocks per
+// commit, writes absorbed, begin_op() waits and checkpoints;
+// and disk requests, blocks per request, the mean queue depth
+// they saw, and their mean and 99th percentile latency. -h
+// prints the disk latency histogram of the whole run at the end.
+// usage: iostat [-h] [interval [count]]
+
+#include "kernel/types.h"
+#include "kernel/bcstat.h"
+#include "kernel/iostat.h"
+#include "user/user.h"
+
+struct iostat first, prev, cur;
+
+// the latency below which pct percent of the requests counted
+// in hist finished, in us, to a power of two.
+uint64
+percentile(uint64 *hist, int pct)
+{
+  uint64 n = 0, sum = 0;
+  int i;
+
+  for(i = 0; i < NIOHIST; i++)
+    n += hist[i];
+  for(i = 0; i < NIOHIST; i++){
+    sum += hist[i];
+    if(n && sum * 100 >= n * pct)
+      break;
+  }
+  return (2L << i) / 1000;
+}
+
+void
+header(void)
+{
+  printf("HIT\tMISS\tEVICT\tAHEAD\tCOMMIT\tBLK/C\tABSORB\tWAIT\tCKPT\t"
+         "READ\tWRITE\tBLK/RQ\tDEPTH\tAVG-US\tP99-US\n");
+}
+
+// print the changes from a to b.
+void
+sample(struct iostat *a, struct iostat *b)
+{
+  uint64 hist[NIOHIST];
+  uint64 commit = b->log.ncommit - a->log.ncommit;
+  uint64 rq = b->disk.nread + b->disk.nwrite - a->disk.nread - a->disk.nwrite;
+  uint64 done = 0;
+  int i;
+
+  for(i = 0; i < NIOHIST; i++){
+    hist[i] = b->disk.hist[i] - a->disk.hist[i];
+    done += hist[i];
+  }
+  printf("%l\t%l\t%l\t%l\t", b->cache.nhit - a->cache.nhit,
+         b->cache.nmiss - a->cache.nmiss, b->cache.nevict - a->cache.nevict,
+         b->cache.nahit - a->cache.nahit);
+  printf("%l\t%l\t%l\t%l\t%l\t", commit,
+         commit ? (b->log.nblk - a->log.nblk) / commit : 0,
+         b->log.nabsorb - a->log.nabsorb, b->log.nwait - a->log.nwait,
+         b->log.ncheckpoint - a->log.ncheckpoint);
+  printf("%l\t%l\t%l\t%l\t%l\t%l\n", b->disk.nread - a->disk.nread,
+         b->disk.nwrite - a->disk.nwrite,
+         rq ? (b->disk.nblk - a->disk.nblk) / rq : 0,
+         rq ? (b->disk.depthsum - a->disk.depthsum) / rq : 0,
+         done ? (b->disk.ns - a->disk.ns) / done / 1000 : 0,
+         done ? percentile(hist, 99) : 0);
+}
+
+// print the latency histogram of the requests between a and b,
+// one line per non-empty power-of-two bucket.
+void
+histogram(struct iostat *a, struct iostat *b)
+{
+  uint64 hist[NIOHIST], max = 0;
+  int i, j, lo, hi;
+
+  for(i = 0; i < NIOHIST; i++){
+    hist[i] = b->disk.hist[i] - a->disk.hist[i];
+    if(hist[i] > max)
+      max = hist[i];
+  }
+  if(max == 0)
+    return;
+  for(lo = 0; hist[lo] == 0; lo++)
+    ;
+  for(hi = NIOHIST-1; hist[hi] == 0; hi--)
+    ;
+  printf("disk latency, max queue depth %d:\n", b->disk.maxdepth);
+  for(i = lo; i <= hi; i++){
+    printf("  %l us\t%l\t", (1L << i) / 1000, hist[i]);
+    for(j = 0; j < hist[i] * 40 / max; j++)
+      printf("@");
+    printf("\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, hflag = 0, interval = 1, count = 0;
+  char **arg = argv + 1;
+
+  if(*arg && strcmp(*arg, "-h") == 0){
+    hflag = 1;
+    arg++;
+  }
+  if(*arg)
+    interval = atoi(*arg++);
+  if(*arg)
+    count = atoi(*arg++);
+  if(interval < 1 || count < 0){
+    fprintf(2, "usage: iostat [-h] [interval [count]]\n");
+    exit(1);
+  }
+
+  if(iostat(&first) < 0){
+    fprintf(2, "iostat: iostat failed\n");
+    exit(1);
+  }
+  prev = first;
+  for(i = 0; count == 0 || i < count; i++){
+    if(i % 20 == 0)
+      header();
+    usleep(interval * 1000000);
+    iostat(&cur);
+    sample(&prev, &cur);
+    prev = cur;
+  }
+  if(hflag)
+    histogram(&first, &cur);
+  exit(0);
+}
@@ -0,0 +1,68 @@
+// Profile the kernel (and user code) while a command runs,
+// by sampling on timer interrupts; see kernel/kprof.c.
+// usage: kprof command [args...]
+//
+// Prints one line per sample:
+//   kprof: hart pid name k|u pc return-address...
+// which kprof.py on the host turns into folded stacks.
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/wait.h"
+#include "kernel/kprof.h"
+#include "user/user.h"
+
+struct ksample buf[16];
+int nsample;
+
+// print the samples waiting in the device, or just
+// discard them if print is 0.
+void
+drain(int fd, int print)
+{
+  int n, i, j;
+
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    for(i = 0; print && i < n / sizeof(buf[0]); i++){
+      struct ksample *s = &buf[i];
+      printf("kprof: %d %d %s %c", s->hart, s->pid,
+             s->pid ? s->name : "-", s->user ? 'u' : 'k');
+      for(j = 0; j < s->depth; j++)
+        printf(" %p", s->pc[j]);
+      printf("\n");
+      nsample++;
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, pid;
+
+  if(argc < 2){
+    fprintf(2, "usage: kprof command [args...]\n");
+    exit(1);
+  }
+  if((fd = open("kprof", O_RDWR)) < 0){
+    fprintf(2, "kprof: cannot open kprof device\n");
+    exit(1);
+  }
+
+  drain(fd, 0);  // throw away old samples
+  write(fd, "1", 1);
+  if((pid = spawn(argv[1], argv+1, 0, 0)) < 0){
+    write(fd, "0", 1);
+    fprintf(2, "kprof: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  // empty the rings now and then so they don't overflow.
+  while(waitpid(pid, 0, WNOHANG) == 0){
+    usleep(500000);
+    drain(fd, 1);
+  }
+  write(fd, "0", 1);
+  drain(fd, 1);
+  printf("kprof: %d samples\n", nsample);
+  exit(0);
+}
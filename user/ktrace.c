@@ -0,0 +1,123 @@
+// Trace kernel events while a command runs; see kernel/trace.c.
+// usage: ktrace [-c category,...] command [args...]
+// where the categories are sched, sleep, log, bcache, disk,
+// syscall or all (the default).
+//
+// Prints one line per event:
+//   ktrace: time hart pid type arg0 arg1
+// which ktrace.py on the host turns into a Chrome trace.
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/wait.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+struct {
+  char *name;
+  int mask;
+} cats[] = {
+  { "sched",   TC_SCHED },
+  { "sleep",   TC_SLEEP },
+  { "log",     TC_LOG },
+  { "bcache",  TC_BCACHE },
+  { "disk",    TC_DISK },
+  { "syscall", TC_SYSCALL },
+  { "all",     TC_ALL },
+};
+
+struct tevent buf[16];
+int nevent;
+
+// parse a comma-separated list of categories into a mask,
+// or return -1.
+int
+parsemask(char *s)
+{
+  int mask = 0, i, n;
+
+  while(*s){
+    for(n = 0; s[n] && s[n] != ','; n++)
+      ;
+    for(i = 0; i < sizeof(cats)/sizeof(cats[0]); i++)
+      if(strlen(cats[i].name) == n && memcmp(cats[i].name, s, n) == 0)
+        break;
+    if(i == sizeof(cats)/sizeof(cats[0]))
+      return -1;
+    mask |= cats[i].mask;
+    s += n;
+    if(*s == ',')
+      s++;
+  }
+  return mask;
+}
+
+// print the events waiting in the device, or just
+// discard them if print is 0.
+void
+drain(int fd, int print)
+{
+  int n, i;
+
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    for(i = 0; print && i < n / sizeof(buf[0]); i++){
+      struct tevent *e = &buf[i];
+      printf("ktrace: %l %d %d %d %l %l\n", e->time, e->hart, e->pid,
+             e->type, e->arg0, e->arg1);
+      nevent++;
+    }
+  }
+}
+
+void
+setmask(int fd, int mask)
+{
+  char s[16];
+  int i = sizeof(s);
+
+  do {
+    s[--i] = '0' + mask % 10;
+    mask /= 10;
+  } while(mask);
+  write(fd, s + i, sizeof(s) - i);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, pid, mask = TC_ALL;
+  char **cmd = argv + 1;
+
+  if(argc >= 3 && strcmp(argv[1], "-c") == 0){
+    if((mask = parsemask(argv[2])) < 0){
+      fprintf(2, "ktrace: unknown category in %s\n", argv[2]);
+      exit(1);
+    }
+    cmd = argv + 3;
+  }
+  if(*cmd == 0){
+    fprintf(2, "usage: ktrace [-c category,...] command [args...]\n");
+    exit(1);
+  }
+  if((fd = open("ktrace", O_RDWR)) < 0){
+    fprintf(2, "ktrace: cannot open ktrace device\n");
+    exit(1);
+  }
+
+  drain(fd, 0);  // throw away old events
+  setmask(fd, mask);
+  if((pid = spawn(cmd[0], cmd, 0, 0)) < 0){
+    setmask(fd, 0);
+    fprintf(2, "ktrace: exec %s failed\n", cmd[0]);
+    exit(1);
+  }
+  // empty the rings now and then so they don't overflow.
+  while(waitpid(pid, 0, WNOHANG) == 0){
+    usleep(100000);
+    drain(fd, 1);
+  }
+  setmask(fd, 0);
+  drain(fd, 1);
+  printf("ktrace: %d events\n", nevent);
+  exit(0);
+}
@@ -0,0 +1,54 @@
+// Show the most contended locks, since boot or while a
+// command runs; see kernel/spinlock.c. For sleeplocks, it
+// also shows how many waits slept, and how many spinning on
+// a running holder avoided.
+// usage: lockstat [-n count] [command args...]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/wait.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+struct lockstat st[64];
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, n, pid, count = 10;
+  char **cmd = argv + 1;
+
+  if(argc >= 3 && strcmp(argv[1], "-n") == 0){
+    count = atoi(argv[2]);
+    cmd = argv + 3;
+  }
+  if(count < 1 || count > sizeof(st)/sizeof(st[0])){
+    fprintf(2, "lockstat: count must be 1 to %d\n", sizeof(st)/sizeof(st[0]));
+    exit(1);
+  }
+  if((fd = open("lockstat", O_RDWR)) < 0){
+    fprintf(2, "lockstat: cannot open lockstat device\n");
+    exit(1);
+  }
+
+  if(*cmd){
+    write(fd, "0", 1);  // reset
+    if((pid = spawn(cmd[0], cmd, 0, 0)) < 0){
+      fprintf(2, "lockstat: exec %s failed\n", cmd[0]);
+      exit(1);
+    }
+    waitpid(pid, 0, 0);
+  }
+
+  if((n = read(fd, st, count * sizeof(st[0]))) < 0){
+    fprintf(2, "lockstat: read failed\n");
+    exit(1);
+  }
+  printf("LOCK\t\tACQUIRE\tCONTEND\tSPIN\tMAXHOLD-NS\tSLEEP\tAVOIDED\n");
+  for(i = 0; i < n / sizeof(st[0]); i++)
+    printf("%s\t%s%l\t%l\t%l\t%l\t\t%l\t%l\n", st[i].name,
+           strlen(st[i].name) < 8 ? "\t" : "", st[i].nacquire,
+           st[i].ncontend, st[i].nspin, st[i].maxhold,
+           st[i].nsleep, st[i].navoid);
+  exit(0);
+}
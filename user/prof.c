@@ -0,0 +1,197 @@
+// Run a command and print where it spent its user time,
+// by sampling its pc on timer interrupts; see kernel/uprof.c.
+// usage: prof command [args...]
+//
+// Function names come from the program's symbol table,
+// command.sym, which the Makefile installs next to it.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/wait.h"
+#include "kernel/uprof.h"
+#include "user/user.h"
+
+#define MAXSAMPLE 4096
+
+struct sym {
+  uint64 addr;
+  char *name;
+  int count;
+};
+
+struct sym *syms;
+int nsym;
+
+uint64 pcs[MAXSAMPLE];
+int npc, lost;
+
+// collect the samples of pid from the kernel.
+void
+drain(int pid)
+{
+  struct usample buf[32];
+  int n, i;
+
+  while((n = uprofread(buf, sizeof(buf)/sizeof(buf[0]))) > 0){
+    for(i = 0; i < n; i++){
+      if(buf[i].pid != pid)
+        continue;
+      if(npc < MAXSAMPLE)
+        pcs[npc++] = buf[i].pc;
+      else
+        lost++;
+    }
+  }
+}
+
+uint64
+hex(char *s)
+{
+  uint64 x = 0;
+
+  for(; *s; s++){
+    if(*s >= '0' && *s <= '9')
+      x = x*16 + *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      x = x*16 + *s - 'a' + 10;
+    else
+      break;
+  }
+  return x;
+}
+
+// read a .sym file, with lines "address name",
+// into syms[], sorted by address.
+int
+loadsyms(char *path)
+{
+  int fd, n, i, j, cap;
+  char *buf, *line, *nl, *sp;
+  struct stat st;
+  struct sym s;
+
+  if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+    return -1;
+  if((buf = malloc(st.size + 1)) == 0 ||
+     (n = read(fd, buf, st.size)) != st.size){
+    if(buf)
+      free(buf);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  buf[n] = 0;
+
+  cap = 0;
+  for(i = 0; i < n; i++)
+    if(buf[i] == '\n')
+      cap++;
+  if((syms = malloc((cap + 1) * sizeof(struct sym))) == 0){
+    free(buf);
+    return -1;
+  }
+  for(line = buf; *line; line = nl + 1){
+    if((nl = strchr(line, '\n')) == 0)
+      break;
+    *nl = 0;
+    if((sp = strchr(line, ' ')) == 0 || sp[1] == '.' || sp[1] == 0)
+      continue;
+    *sp = 0;
+    s.addr = hex(line);
+    s.name = sp + 1;
+    s.count = 0;
+    for(j = nsym; j > 0 && syms[j-1].addr > s.addr; j--)
+      syms[j] = syms[j-1];
+    syms[j] = s;
+    nsym++;
+  }
+  return 0;
+}
+
+// the symbol containing pc, or 0.
+struct sym*
+lookup(uint64 pc)
+{
+  int lo = 0, hi = nsym;
+
+  // find the last symbol at or below pc.
+  while(lo < hi){
+    int mid = (lo + hi) / 2;
+    if(syms[mid].addr <= pc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo > 0 ? &syms[lo-1] : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char path[64], *name;
+  int pid, i, j, best, unknown;
+  struct sym *s;
+
+  if(argc < 2){
+    fprintf(2, "usage: prof command [args...]\n");
+    exit(1);
+  }
+
+  if(uprof(1) < 0){
+    fprintf(2, "prof: uprof failed\n");
+    exit(1);
+  }
+  if((pid = spawn(argv[1], argv+1, 0, 0)) < 0){
+    fprintf(2, "prof: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  uprof(0);
+  // empty the kernel's buffer now and then so it doesn't fill.
+  while(waitpid(pid, 0, WNOHANG) == 0){
+    usleep(200000);
+    drain(pid);
+  }
+  drain(pid);
+
+  // cmd.sym, for the last component of cmd.
+  for(name = argv[1]; strchr(name, '/'); name = strchr(name, '/') + 1)
+    ;
+  if(strlen(name) + 5 > sizeof(path)){
+    fprintf(2, "prof: name too long\n");
+    exit(1);
+  }
+  strcpy(path, name);
+  strcpy(path + strlen(name), ".sym");
+  if(loadsyms(path) < 0)
+    fprintf(2, "prof: cannot read %s, no function names\n", path);
+
+  unknown = 0;
+  for(i = 0; i < npc; i++){
+    if((s = lookup(pcs[i])) != 0)
+      s->count++;
+    else
+      unknown++;
+  }
+
+  printf("%d samples", npc);
+  if(lost)
+    printf(", %d lost", lost);
+  printf("\n");
+  if(npc == 0)
+    exit(0);
+  // print the functions by decreasing count.
+  for(;;){
+    best = -1;
+    for(j = 0; j < nsym; j++)
+      if(syms[j].count > 0 && (best < 0 || syms[j].count > syms[best].count))
+        best = j;
+    if(best < 0)
+      break;
+    printf("%d\t%d%%\t%s\n", syms[best].count, syms[best].count * 100 / npc, syms[best].name);
+    syms[best].count = 0;
+  }
+  if(unknown)
+    printf("%d\t%d%%\t?\n", unknown, unknown * 100 / npc);
+  exit(0);
+}
@@ -0,0 +1,102 @@
+// Time reading files through, a block per read() as cat
+// does, and report the rate and how much was read ahead.
+// Only blocks not yet cached come from the disk, so for the
+// disk's speed name files not read since boot, such as
+// "readbench usertests"; with no arguments, it writes and
+// reads a file of MAXFILE blocks, which stays cached. It also
+// counts disk requests per megabyte moved, reading or writing.
+// usage: readbench [file...]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/time.h"
+#include "kernel/bcstat.h"
+#include "user/user.h"
+
+char *file = "readbench.tmp";
+char buf[BSIZE];
+
+uint64
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+// report the disk requests between two bcstat()s, and how
+// many a megabyte took.
+void
+requests(char *what, struct bcstat *before, struct bcstat *after)
+{
+  uint64 reqs = after->nreq - before->nreq;
+  uint64 blks = after->nreqblk - before->nreqblk;
+
+  printf("%s: %l disk requests, %l per MB\n", what, reqs,
+         blks ? reqs * (1024*1024/BSIZE) / blks : 0);
+}
+
+void
+bench(char *path)
+{
+  struct bcstat before, after;
+  uint64 t0, t, bytes, rate;
+  int fd, n;
+
+  if((fd = open(path, O_RDONLY)) < 0){
+    fprintf(2, "readbench: cannot open %s\n", path);
+    exit(1);
+  }
+  bcstat(&before);
+  bytes = 0;
+  t0 = now();
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    bytes += n;
+  t = now() - t0;
+  bcstat(&after);
+  close(fd);
+
+  // MB/s, in hundredths.
+  rate = t ? bytes * 1000000000 / t * 100 / (1024*1024) : 0;
+  printf("%s: %l KB in %l us, %l.%l%l MB/s\n", path, bytes / 1024, t / 1000,
+         rate / 100, rate / 10 % 10, rate % 10);
+  printf("%s: %l misses, %l blocks read ahead, %l of them used\n", path,
+         after.nmiss - before.nmiss, after.nahead - before.nahead,
+         after.nahit - before.nahit);
+  requests(path, &before, &after);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bcstat before, after;
+  int fd, i;
+
+  if(argc > 1){
+    for(i = 1; i < argc; i++)
+      bench(argv[i]);
+    exit(0);
+  }
+
+  bcstat(&before);
+  fd = open(file, O_CREATE|O_WRONLY);
+  if(fd < 0){
+    fprintf(2, "readbench: cannot create %s\n", file);
+    exit(1);
+  }
+  for(i = 0; i < MAXFILE; i++){
+    memset(buf, i, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "readbench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+  bcstat(&after);
+  requests("write", &before, &after);
+  bench(file);
+  unlink(file);
+  exit(0);
+}
@@ -0,0 +1,79 @@
+// Show how often each system call has been made and how long
+// the calls took, since boot or while a command runs.
+// usage: scstat [-h] [command args...]
+// -h also prints each system call's latency histogram.
+
+#include "kernel/types.h"
+#include "kernel/wait.h"
+#include "kernel/scstat.h"
+#include "user/user.h"
+
+#define NSC 64
+
+struct scstat before[NSC], after[NSC];
+
+// print the histogram of one system call, one line per
+// non-empty power-of-two bucket.
+void
+histogram(struct scstat *s)
+{
+  int i, j, max = 0, lo, hi;
+
+  for(lo = 0; lo < NSCHIST && s->hist[lo] == 0; lo++)
+    ;
+  for(hi = NSCHIST-1; hi > lo && s->hist[hi] == 0; hi--)
+    ;
+  for(i = lo; i <= hi; i++)
+    if(s->hist[i] > max)
+      max = s->hist[i];
+  for(i = lo; i <= hi; i++){
+    printf("  %l ns\t%l\t", 1L << i, s->hist[i]);
+    for(j = 0; j < s->hist[i] * 40 / max; j++)
+      printf("@");
+    printf("\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n, pid, hflag = 0;
+  char **cmd = argv + 1;
+
+  if(argc > 1 && strcmp(argv[1], "-h") == 0){
+    hflag = 1;
+    cmd++;
+  }
+  if(*cmd){
+    scstats(before, NSC);
+    if((pid = spawn(cmd[0], cmd, 0, 0)) < 0){
+      fprintf(2, "scstat: exec %s failed\n", cmd[0]);
+      exit(1);
+    }
+    waitpid(pid, 0, 0);
+  }
+  if((n = scstats(after, NSC)) < 0){
+    fprintf(2, "scstat: scstats failed\n");
+    exit(1);
+  }
+  if(n > NSC)
+    n = NSC;
+
+  printf("NAME\t\t\tCALLS\tAVG-NS\tTOTAL-US\n");
+  for(i = 0; i < n; i++){
+    struct scstat *s = &after[i];
+    s->count -= before[i].count;
+    s->ns -= before[i].ns;
+    for(j = 0; j < NSCHIST; j++)
+      s->hist[j] -= before[i].hist[j];
+    if(s->name[0] == 0 || s->count == 0)
+      continue;
+    printf("%s", s->name);
+    for(j = strlen(s->name); j < 24; j += 8)
+      printf("\t");
+    printf("%l\t%l\t%l\n", s->count, s->ns / s->count, s->ns / 1000);
+    if(hflag)
+      histogram(s);
+  }
+  exit(0);
+}
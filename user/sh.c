@@ -3,6 +3,7 @@
 #include "kernel/types.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/spawn.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,6 +53,7 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
 
 // Execute cmd.  Never returns.
 void
@@ -141,11 +143,121 @@ getcmd(char *buf, int nbuf)
   return 0;
 }
 
+// Can cmd be run by spawn() alone, rather than by a forked
+// copy of the shell? nfa file actions are already needed.
+int
+spawnable(struct cmd *cmd, int nfa)
+{
+  struct pipecmd *pcmd;
+
+  switch(cmd->type){
+  case EXEC:
+    return nfa <= MAXSPAWNFA;
+  case REDIR:
+    return spawnable(((struct redircmd*)cmd)->cmd, nfa+1);
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    return spawnable(pcmd->left, nfa+3) && spawnable(pcmd->right, nfa+3);
+  }
+  return 0;
+}
+
+// Start the processes of a spawnable() cmd, each with the
+// nfa file actions in fa applied first, and append their
+// pids to pids[*npids].
+void
+spawncmd(struct cmd *cmd, struct spawnfa *fa, int nfa, int *pids, int *npids)
+{
+  int p[2], pid;
+  struct execcmd *ecmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(ecmd->argv[0] == 0)
+      break;
+    if((pid = spawn(ecmd->argv[0], ecmd->argv, fa, nfa)) < 0){
+      fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+      break;
+    }
+    pids[(*npids)++] = pid;
+    break;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    fa[nfa].op = SPAWN_OPEN;
+    fa[nfa].fd = rcmd->fd;
+    fa[nfa].omode = rcmd->mode;
+    fa[nfa].path = rcmd->file;
+    spawncmd(rcmd->cmd, fa, nfa+1, pids, npids);
+    break;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    if(pipe(p) < 0){
+      fprintf(2, "pipe failed\n");
+      break;
+    }
+    fa[nfa+1].op = SPAWN_CLOSE;
+    fa[nfa+1].fd = p[0];
+    fa[nfa+2].op = SPAWN_CLOSE;
+    fa[nfa+2].fd = p[1];
+    fa[nfa].op = SPAWN_DUP2;
+    fa[nfa].fd = 1;
+    fa[nfa].oldfd = p[1];
+    spawncmd(pcmd->left, fa, nfa+3, pids, npids);
+    fa[nfa+1].op = SPAWN_CLOSE;
+    fa[nfa+1].fd = p[0];
+    fa[nfa+2].op = SPAWN_CLOSE;
+    fa[nfa+2].fd = p[1];
+    fa[nfa].op = SPAWN_DUP2;
+    fa[nfa].fd = 0;
+    fa[nfa].oldfd = p[0];
+    spawncmd(pcmd->right, fa, nfa+3, pids, npids);
+    close(p[0]);
+    close(p[1]);
+    break;
+  }
+}
+
+// Run cmd and wait for it to finish.
+void
+run(struct cmd *cmd)
+{
+  struct spawnfa fa[MAXSPAWNFA];
+  int pids[MAXSPAWNFA];
+  int i, npids, pid;
+
+  if(cmd->type == LIST){
+    run(((struct listcmd*)cmd)->left);
+    run(((struct listcmd*)cmd)->right);
+    return;
+  }
+
+  // most commands are a program, perhaps with redirections
+  // or in a pipeline: start them without copying the shell.
+  if(spawnable(cmd, 0)){
+    npids = 0;
+    spawncmd(cmd, fa, 0, pids, &npids);
+    for(i = 0; i < npids; i++)
+      waitpid(pids[i], 0, 0);
+    return;
+  }
+
+  pid = fork1();
+  if(pid == 0)
+    runcmd(cmd);
+  waitpid(pid, 0, 0);
+}
+
 int
 main(void)
 {
   static char buf[100];
   int fd;
+  struct cmd *cmd;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -164,9 +276,10 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait(0);
+    if((cmd = parsecmd(buf)) != 0){
+      run(cmd);
+      freecmd(cmd);
+    }
   }
   exit(0);
 }
@@ -319,6 +432,18 @@ peek(char **ps, char *es, char *toks)
   return *s && strchr(toks, *s);
 }
 
+// The shell parses commands itself rather than in a child,
+// so a syntax error must not exit.
+int parseerr;
+
+void
+syntaxerr(char *s)
+{
+  if(!parseerr)
+    fprintf(2, "%s\n", s);
+  parseerr = 1;
+}
+
 struct cmd *parseline(char**, char*);
 struct cmd *parsepipe(char**, char*);
 struct cmd *parseexec(char**, char*);
@@ -330,12 +455,17 @@ parsecmd(char *s)
   char *es;
   struct cmd *cmd;
 
+  parseerr = 0;
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !parseerr){
     fprintf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntaxerr("syntax");
+  }
+  if(parseerr){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -379,8 +509,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntaxerr("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -405,8 +537,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntaxerr("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -431,13 +565,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntaxerr("syntax");
+      break;
+    }
+    if(argc+1 >= MAXARGS){
+      syntaxerr("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -491,3 +629,41 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+// Free a command tree from parsecmd().
+void
+freecmd(struct cmd *cmd)
+{
+  struct backcmd *bcmd;
+  struct listcmd *lcmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    freecmd(rcmd->cmd);
+    break;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    freecmd(pcmd->left);
+    freecmd(pcmd->right);
+    break;
+
+  case LIST:
+    lcmd = (struct listcmd*)cmd;
+    freecmd(lcmd->left);
+    freecmd(lcmd->right);
+    break;
+
+  case BACK:
+    bcmd = (struct backcmd*)cmd;
+    freecmd(bcmd->cmd);
+    break;
+  }
+  free(cmd);
+}
@@ -0,0 +1,90 @@
+// Compare how many commands per second fork()+exec() and
+// spawn() can start, as the parent's memory grows.
+// Each command is this program run as "spawnbench -x",
+// which exits at once.
+
+#include "kernel/types.h"
+#include "kernel/time.h"
+#include "user/user.h"
+
+#define N 200
+
+char *cmd[] = { "spawnbench", "-x", 0 };
+
+uint64
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+void
+forkexec(void)
+{
+  int pid;
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "spawnbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(cmd[0], cmd);
+    fprintf(2, "spawnbench: exec failed\n");
+    exit(1);
+  }
+  waitpid(pid, 0, 0);
+}
+
+void
+spawnone(void)
+{
+  int pid;
+
+  if((pid = spawn(cmd[0], cmd, 0, 0)) < 0){
+    fprintf(2, "spawnbench: spawn failed\n");
+    exit(1);
+  }
+  waitpid(pid, 0, 0);
+}
+
+// run fn N times and return commands per second.
+int
+rate(void (*fn)(void))
+{
+  uint64 t0, t;
+
+  t0 = now();
+  for(int i = 0; i < N; i++)
+    fn();
+  t = now() - t0;
+  if(t == 0)
+    t = 1;
+  return (uint64)N * NSEC_PER_SEC / t;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb, grown;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);
+
+  printf("parent KB\tfork+exec/s\tspawn/s\n");
+  grown = 0;
+  for(kb = 0; kb <= 4096; kb = kb ? kb*4 : 64){
+    // touch the new memory, so fork() has to copy it.
+    char *p = sbrk((kb - grown) * 1024);
+    if(p == (char*)-1){
+      fprintf(2, "spawnbench: sbrk failed\n");
+      exit(1);
+    }
+    memset(p, 1, (kb - grown) * 1024);
+    grown = kb;
+    printf("%d\t\t%d\t\t%d\n", kb, rate(forkexec), rate(spawnone));
+  }
+  exit(0);
+}
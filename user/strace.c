@@ -0,0 +1,61 @@
+// Run a command, printing the system calls it and its
+// children make, with their arguments and return values.
+// usage: strace [-e name,...] command [args...]
+// -e traces only the named system calls.
+
+#include "kernel/types.h"
+#include "kernel/scstat.h"
+#include "user/user.h"
+
+#define NSC 64
+
+struct scstat st[NSC];
+
+// parse a comma-separated list of system call names into a
+// mask, or return 0.
+uint64
+parsemask(char *s, int n)
+{
+  uint64 mask = 0;
+  int i, len;
+
+  while(*s){
+    for(len = 0; s[len] && s[len] != ','; len++)
+      ;
+    for(i = 0; i < n; i++)
+      if(strlen(st[i].name) == len && memcmp(st[i].name, s, len) == 0)
+        break;
+    if(i == n){
+      fprintf(2, "strace: no system call %s\n", s);
+      return 0;
+    }
+    mask |= 1L << i;
+    s += len;
+    if(*s == ',')
+      s++;
+  }
+  return mask;
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 mask = ~0L;
+  char **cmd = argv + 1;
+  int n;
+
+  if(argc >= 3 && strcmp(argv[1], "-e") == 0){
+    if((n = scstats(st, NSC)) < 0 || (mask = parsemask(argv[2], n)) == 0)
+      exit(1);
+    cmd = argv + 3;
+  }
+  if(*cmd == 0){
+    fprintf(2, "usage: strace [-e name,...] command [args...]\n");
+    exit(1);
+  }
+  strace(mask);
+  exec(cmd[0], cmd);
+  strace(0);
+  fprintf(2, "strace: exec %s failed\n", cmd[0]);
+  exit(1);
+}
@@ -0,0 +1,85 @@
+// Threads built on clone() and join(), in the style of pthreads.
+// malloc() isn't thread-safe, so create and join threads
+// from one thread at a time.
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define TSTACK 4096  // bytes of user stack per thread
+
+// kept at the top of each thread's stack.
+struct tstart {
+  void *(*fn)(void*);
+  void *arg;
+  void *ret;    // fn's return value, for thread_join()
+  char *stack;  // as returned by malloc()
+};
+
+static void
+tstart(void *a)
+{
+  struct tstart *ts = a;
+
+  ts->ret = ts->fn(ts->arg);
+  exit(0);
+}
+
+// Run fn(arg) in a new thread sharing this address space.
+// Returns the new thread's id, or -1.
+int
+thread_create(void *(*fn)(void*), void *arg)
+{
+  char *stack;
+  struct tstart *ts;
+  int tid;
+
+  if((stack = malloc(TSTACK)) == 0)
+    return -1;
+  // the stack grows down from just below ts,
+  // which must be 16-byte aligned.
+  ts = (struct tstart*)(((uint64)stack + TSTACK) & ~15L) - 1;
+  ts->fn = fn;
+  ts->arg = arg;
+  ts->ret = 0;
+  ts->stack = stack;
+  if((tid = clone(tstart, ts, ts)) < 0)
+    free(stack);
+  return tid;
+}
+
+// Wait for thread tid to finish, and free its stack.
+// If ret isn't 0, store the thread function's return value there.
+// Returns tid, or -1.
+int
+thread_join(int tid, void **ret)
+{
+  struct tstart *ts;
+
+  if((tid = join(tid, (void**)&ts)) < 0)
+    return -1;
+  if(ret)
+    *ret = ts->ret;
+  free(ts->stack);
+  return tid;
+}
+
+void
+lock_init(struct lock *lk)
+{
+  lk->locked = 0;
+}
+
+void
+lock_acquire(struct lock *lk)
+{
+  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
+    ;
+  __sync_synchronize();
+}
+
+void
+lock_release(struct lock *lk)
+{
+  __sync_synchronize();
+  __sync_lock_release(&lk->locked);
+}
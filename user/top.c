@@ -0,0 +1,96 @@
+// Show which processes are using the CPU, memory and I/O,
+// refreshing every few seconds.
+// usage: top [-n iterations] [-d seconds]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/rusage.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+// indexed by procinfo.state, in the order of enum procstate.
+char *states[] = { "?", "U", "S", "R", "X", "Z" };
+
+struct procinfo cur[NPROC], prev[NPROC];
+int ncur, nprev;
+
+// ticks of CPU time p has used since the last sample.
+int
+cputicks(struct procinfo *p)
+{
+  uint64 t = p->ru.utime + p->ru.stime;
+
+  for(int i = 0; i < nprev; i++)
+    if(prev[i].pid == p->pid)
+      return t - (prev[i].ru.utime + prev[i].ru.stime);
+  return t;
+}
+
+void
+show(int elapsed)
+{
+  struct hartstat hs[NCPU];
+  int order[NPROC], busy[NPROC];
+  int i, j, n, t;
+
+  n = hartstat(hs, NCPU);
+  for(i = 0; i < n; i++)
+    if(hs[i].online)
+      printf("cpu%d: %d runnable, %l migrated in\n", i, hs[i].nrun, hs[i].nmigrate);
+
+  // sort by CPU use since the last sample, busiest first.
+  for(i = 0; i < ncur; i++){
+    busy[i] = cputicks(&cur[i]);
+    for(j = i; j > 0 && busy[order[j-1]] < busy[i]; j--)
+      order[j] = order[j-1];
+    order[j] = i;
+  }
+
+  printf("PID\tPPID\tS\tCPU\t%%CPU\tUTIME\tSTIME\tVCSW\tIVCSW\tSEGV\tREAD\tWRITE\tKB\tMAXKB\tNAME\n");
+  for(i = 0; i < ncur; i++){
+    struct procinfo *p = &cur[order[i]];
+    t = elapsed > 0 ? busy[order[i]] * 100 / elapsed : 0;
+    printf("%d\t%d\t%s\t%d\t%d\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%s\n",
+           p->pid, p->ppid, p->state < 6 ? states[p->state] : "?",
+           p->cpu, t, p->ru.utime, p->ru.stime, p->ru.nvcsw,
+           p->ru.nivcsw, p->ru.nsegv, p->ru.rbytes, p->ru.wbytes,
+           p->sz / 1024, p->ru.maxsz / 1024, p->name);
+  }
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int iterations = 5, delay = 1;
+  int i, t0, t1;
+
+  for(i = 1; i + 1 < argc; i += 2){
+    if(strcmp(argv[i], "-n") == 0)
+      iterations = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-d") == 0)
+      delay = atoi(argv[i+1]);
+    else
+      break;
+  }
+  if(i < argc || delay <= 0){
+    fprintf(2, "usage: top [-n iterations] [-d seconds]\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  for(i = 0; i < iterations; i++){
+    if(i > 0)
+      usleep(delay * 1000000);
+    t1 = uptime();
+    if((ncur = procinfo(cur, NPROC)) < 0){
+      fprintf(2, "top: procinfo failed\n");
+      exit(1);
+    }
+    show(t1 - t0);
+    memmove(prev, cur, ncur * sizeof(cur[0]));
+    nprev = ncur;
+    t0 = t1;
+  }
+  exit(0);
+}
@@ -134,3 +134,10 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// sleep for at least us microseconds.
+int
+usleep(uint us)
+{
+  return nanosleep((uint64)us * 1000);
+}
@@ -0,0 +1,172 @@
+// Compare plain read() and write() with a uring: reading a
+// file of NBLK blocks, with several disk requests in flight,
+// and many small operations, batched per kernel entry.
+// usage: uringbench [nworker]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/time.h"
+#include "kernel/uring.h"
+#include "user/user.h"
+
+#define NBLK 200     // blocks in the test file
+#define NOP  2000    // operations in the small-operation tests
+
+char *file = "uringbench.tmp";
+char data[NBLK][BSIZE];
+struct uringbuf *u;
+int nenter;
+
+uint64
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+// add an entry to the submission queue; returns 0 if it is full.
+int
+submit(int op, int fd, void *addr, int n, int off, uint64 tag)
+{
+  struct sqe *e;
+
+  if(u->sqtail - u->sqhead == NSQE)
+    return 0;
+  e = &u->sq[u->sqtail % NSQE];
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->n = n;
+  e->off = off;
+  e->data = tag;
+  __sync_synchronize();  // the entry before the new tail.
+  u->sqtail++;
+  return 1;
+}
+
+// consume the waiting completions; returns how many, and
+// exits if one of them failed to move want bytes.
+int
+reap(int want)
+{
+  struct cqe *c;
+  int n = 0;
+
+  while(u->cqhead != u->cqtail){
+    __sync_synchronize();  // read the entry after the tail.
+    c = &u->cq[u->cqhead % NCQE];
+    if(c->res != want){
+      fprintf(2, "uringbench: request %l returned %d\n", c->data, c->res);
+      exit(1);
+    }
+    u->cqhead++;
+    n++;
+  }
+  return n;
+}
+
+// hand everything queued to the kernel and wait for at
+// least min completions.
+void
+enter(int min)
+{
+  if(uring_enter(NSQE, min) < 0){
+    fprintf(2, "uringbench: uring_enter failed\n");
+    exit(1);
+  }
+  nenter++;
+}
+
+void
+report(char *what, uint64 t, int bytes, int ncall)
+{
+  printf("%s: %l us", what, t / 1000);
+  if(bytes)
+    printf(", %l KB/s", (uint64)bytes * 1000000 / t);
+  printf(", %d kernel entries\n", ncall);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, done, nworker = 4;
+  uint64 t0;
+
+  if(argc > 1)
+    nworker = atoi(argv[1]);
+  if((u = uring_setup(nworker)) == (struct uringbuf*)-1){
+    fprintf(2, "uringbench: uring_setup failed\n");
+    exit(1);
+  }
+  printf("uringbench: %d blocks, %d workers\n", NBLK, nworker);
+
+  // the file, written with write().
+  fd = open(file, O_CREATE|O_RDWR);
+  if(fd < 0){
+    fprintf(2, "uringbench: cannot create %s\n", file);
+    exit(1);
+  }
+  t0 = now();
+  for(i = 0; i < NBLK; i++){
+    memset(data[i], i, BSIZE);
+    if(write(fd, data[i], BSIZE) != BSIZE){
+      fprintf(2, "uringbench: write failed\n");
+      exit(1);
+    }
+  }
+  report("write", now() - t0, NBLK*BSIZE, NBLK);
+
+  // read it back with read(). There are more blocks than
+  // the buffer cache holds, so most come from the disk.
+  close(fd);
+  fd = open(file, O_RDONLY);
+  t0 = now();
+  for(i = 0; i < NBLK; i++){
+    if(read(fd, data[i], BSIZE) != BSIZE){
+      fprintf(2, "uringbench: read failed\n");
+      exit(1);
+    }
+  }
+  report("read", now() - t0, NBLK*BSIZE, NBLK);
+
+  // and through the uring, one request per block, each at
+  // its own offset, so the workers can overlap them.
+  nenter = 0;
+  t0 = now();
+  for(i = done = 0; done < NBLK; ){
+    while(i < NBLK && submit(UR_READ, fd, data[i], BSIZE, i*BSIZE, i))
+      i++;
+    enter(1);
+    done += reap(BSIZE);
+  }
+  report("uring read", now() - t0, NBLK*BSIZE, nenter);
+  for(i = 0; i < NBLK; i++){
+    if(data[i][0] != (char)i || data[i][BSIZE-1] != (char)i){
+      fprintf(2, "uringbench: block %d read back wrong\n", i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink(file);
+
+  // small operations: one trap each, or a queue-full per trap.
+  t0 = now();
+  for(i = 0; i < NOP; i++)
+    getpid();
+  report("getpid", now() - t0, 0, NOP);
+
+  nenter = 0;
+  t0 = now();
+  for(i = done = 0; done < NOP; ){
+    while(i < NOP && submit(UR_NOP, 0, 0, 0, 0, i))
+      i++;
+    enter(1);
+    done += reap(0);
+  }
+  report("uring nop", now() - t0, 0, nenter);
+
+  exit(0);
+}
@@ -1,5 +1,15 @@
 struct stat;
 struct rtcdate;
+struct timespec;
+struct hartstat;
+struct spawnfa;
+struct rusage;
+struct procinfo;
+struct usample;
+struct scstat;
+struct uringbuf;
+struct bcstat;
+struct iostat;
 
 // system calls
 int fork(void);
@@ -23,6 +33,26 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int waitpid(int, int*, int);
+int clone(void(*)(void*), void*, void*);
+int join(int, void**);
+int nanosleep(uint64);
+int clock_gettime(int, struct timespec*);
+int sched_setaffinity(int, uint64);
+int sched_getaffinity(int);
+int hartstat(struct hartstat*, int);
+int spawn(const char*, char**, struct spawnfa*, int);
+int getrusage(int, struct rusage*);
+int procinfo(struct procinfo*, int);
+int uprof(int);
+int uprofread(struct usample*, int);
+int strace(uint64);
+int scstats(struct scstat*, int);
+struct uringbuf* uring_setup(int);
+int uring_enter(int, int);
+int bcstat(struct bcstat*);
+int bcctl(int, int);
+int iostat(struct iostat*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -40,3 +70,14 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+int usleep(uint);
+
+// thread.c
+struct lock {
+  uint locked;
+};
+int thread_create(void *(*)(void*), void*);
+int thread_join(int, void**);
+void lock_init(struct lock*);
+void lock_acquire(struct lock*);
+void lock_release(struct lock*);
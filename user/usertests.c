@@ -4,6 +4,19 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/wait.h"
+#include "kernel/time.h"
+#include "kernel/sched.h"
+#include "kernel/spawn.h"
+#include "kernel/rusage.h"
+#include "kernel/kprof.h"
+#include "kernel/uprof.h"
+#include "kernel/trace.h"
+#include "kernel/scstat.h"
+#include "kernel/uring.h"
+#include "kernel/lockstat.h"
+#include "kernel/bcstat.h"
+#include "kernel/iostat.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -819,6 +832,1027 @@ exitwait(char *s)
   }
 }
 
+// waitpid() should reap only the requested child,
+// and WNOHANG should not block while it is still running.
+void
+waitpidtest(char *s)
+{
+  int pid1, pid2, fds[2], xstate;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid1 = fork();
+  if(pid1 < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid1 == 0){
+    close(fds[1]);
+    read(fds[0], &c, 1);
+    exit(3);
+  }
+  pid2 = fork();
+  if(pid2 < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid2 == 0)
+    exit(4);
+  close(fds[0]);
+
+  if(waitpid(pid1, &xstate, WNOHANG) != 0){
+    printf("%s: WNOHANG returned a running child\n", s);
+    exit(1);
+  }
+  if(waitpid(pid2, &xstate, 0) != pid2 || xstate != 4){
+    printf("%s: waitpid wrong pid or status\n", s);
+    exit(1);
+  }
+  if(waitpid(pid2, 0, WNOHANG) != -1){
+    printf("%s: waitpid reaped a child twice\n", s);
+    exit(1);
+  }
+  write(fds[1], "x", 1);
+  close(fds[1]);
+  if(waitpid(-1, &xstate, 0) != pid1 || xstate != 3){
+    printf("%s: waitpid(-1) wrong pid or status\n", s);
+    exit(1);
+  }
+  if(waitpid(-1, 0, WNOHANG) != -1){
+    printf("%s: waitpid with no children\n", s);
+    exit(1);
+  }
+}
+
+// threads from thread_create() share memory, open files and
+// the current directory, and exit() of the process takes down
+// threads that are still running.
+struct lock threadlock;
+int threadcount;
+char *threadmem;
+int threadfd;
+
+void *
+threadworker(void *arg)
+{
+  for(int i = 0; i < 1000; i++){
+    lock_acquire(&threadlock);
+    threadcount++;
+    lock_release(&threadlock);
+  }
+  return arg;
+}
+
+void *
+threadspin(void *arg)
+{
+  for(;;)
+    ;
+}
+
+void *
+threadsbrk(void *arg)
+{
+  threadmem = sbrk(PGSIZE);
+  threadmem[0] = 'x';
+  return 0;
+}
+
+void *
+threadfiles(void *arg)
+{
+  threadfd = open("threadtest.tmp", O_CREATE|O_RDWR);
+  if(chdir("threadtest.d") < 0)
+    return (void*)1;
+  return 0;
+}
+
+void
+threadtest(char *s)
+{
+  int tids[4], pid, xstate, fd;
+  void *ret;
+
+  lock_init(&threadlock);
+  for(int i = 0; i < 4; i++){
+    if((tids[i] = thread_create(threadworker, (void*)(uint64)i)) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(int i = 0; i < 4; i++){
+    if(thread_join(tids[i], &ret) != tids[i] || ret != (void*)(uint64)i){
+      printf("%s: thread_join failed\n", s);
+      exit(1);
+    }
+  }
+  if(threadcount != 4000){
+    printf("%s: lost updates, count %d\n", s, threadcount);
+    exit(1);
+  }
+  if(thread_join(-1, 0) != -1){
+    printf("%s: thread_join with no threads\n", s);
+    exit(1);
+  }
+
+  // memory grown by a thread is visible to the others.
+  if((tids[0] = thread_create(threadsbrk, 0)) < 0 ||
+     thread_join(tids[0], 0) != tids[0] || threadmem[0] != 'x'){
+    printf("%s: sbrk in thread failed\n", s);
+    exit(1);
+  }
+
+  // a file opened, and the directory changed, by a thread.
+  if(mkdir("threadtest.d") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  if((tids[0] = thread_create(threadfiles, 0)) < 0 ||
+     thread_join(tids[0], &ret) != tids[0] || ret != 0 || threadfd < 0){
+    printf("%s: open or chdir in thread failed\n", s);
+    exit(1);
+  }
+  if(write(threadfd, "x", 1) != 1 || close(threadfd) != 0){
+    printf("%s: file opened by thread not shared\n", s);
+    exit(1);
+  }
+  if((fd = open("threadtest.in", O_CREATE|O_RDWR)) < 0 || close(fd) < 0 ||
+     chdir("..") < 0 || unlink("threadtest.d/threadtest.in") < 0){
+    printf("%s: chdir in thread not shared\n", s);
+    exit(1);
+  }
+  unlink("threadtest.d");
+  unlink("threadtest.tmp");
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(thread_create(threadspin, 0) < 0)
+      exit(1);
+    sleep(1);
+    exit(7);
+  }
+  if(wait(&xstate) != pid || xstate != 7){
+    printf("%s: exit with running thread failed\n", s);
+    exit(1);
+  }
+}
+
+static uint64
+nsnow(void)
+{
+  struct timespec ts;
+
+  if(clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+    return 0;
+  return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+// nanosleep() sleeps about as long as asked, even
+// for much less than a scheduler tick.
+void
+nanosleeptest(char *s)
+{
+  uint64 t0, t1;
+  struct timespec ts;
+
+  if(clock_gettime(-1, &ts) != -1){
+    printf("%s: clock_gettime accepted a bad clock\n", s);
+    exit(1);
+  }
+  t0 = nsnow();
+  t1 = nsnow();
+  if(t0 == 0 || t1 < t0){
+    printf("%s: clock_gettime failed\n", s);
+    exit(1);
+  }
+
+  for(int i = 0; i < 10; i++){
+    t0 = nsnow();
+    if(usleep(2000) < 0){
+      printf("%s: usleep failed\n", s);
+      exit(1);
+    }
+    t1 = nsnow();
+    if(t1 - t0 < 2000000){
+      printf("%s: woke up early, after %d ns\n", s, (int)(t1 - t0));
+      exit(1);
+    }
+  }
+
+  // a much shorter sleep than a tick shouldn't take a tick.
+  t0 = nsnow();
+  for(int i = 0; i < 10; i++)
+    nanosleep(100000);
+  t1 = nsnow();
+  if(t1 - t0 >= 10 * (NSEC_PER_SEC / 10)){
+    printf("%s: nanosleep rounds up to ticks\n", s);
+    exit(1);
+  }
+}
+
+// many processes sleeping for different numbers of ticks
+// each wake up after neither less nor much more than asked.
+void
+sleepmany(char *s)
+{
+  enum { N = 20 };
+  int pid, xstate;
+
+  for(int i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      int n = 1 + i % 7;
+      int t0 = uptime();
+      if(sleep(n) < 0)
+        exit(1);
+      int t = uptime() - t0;
+      exit(t < n || t > n + 5);
+    }
+  }
+  for(int i = 0; i < N; i++){
+    if(wait(&xstate) < 0 || xstate != 0){
+      printf("%s: sleep was the wrong length\n", s);
+      exit(1);
+    }
+  }
+}
+
+// sched_setaffinity() pins a process to a CPU,
+// and hartstat() sees it there.
+void
+affinitytest(char *s)
+{
+  struct hartstat hs[NCPU];
+  int n, pid, xstate;
+
+  n = hartstat(hs, NCPU);
+  if(n != NCPU || !hs[0].online){
+    printf("%s: hartstat failed\n", s);
+    exit(1);
+  }
+  if(hartstat(hs, -1) != -1){
+    printf("%s: hartstat accepted a negative count\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, 0) != -1 || sched_setaffinity(-1, 1) != -1){
+    printf("%s: sched_setaffinity accepted bad arguments\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(;;)
+      ;
+  }
+  if(sched_setaffinity(pid, 1) != 0 || sched_getaffinity(pid) != 1){
+    printf("%s: sched_setaffinity of child failed\n", s);
+    exit(1);
+  }
+  sleep(2);
+  hartstat(hs, NCPU);
+  if(hs[0].nrun < 1){
+    printf("%s: pinned child isn't on CPU 0\n", s);
+    exit(1);
+  }
+  kill(pid);
+  wait(0);
+
+  // the calling process moves itself, and its children
+  // inherit the mask.
+  if(sched_setaffinity(0, 1) != 0 || sched_getaffinity(0) != 1){
+    printf("%s: sched_setaffinity of self failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(sched_getaffinity(0));
+  if(wait(&xstate) != pid || xstate != 1){
+    printf("%s: child didn't inherit affinity\n", s);
+    exit(1);
+  }
+}
+
+// spawn() runs a program with its file actions applied,
+// and fails cleanly on bad arguments.
+void
+spawntest(char *s)
+{
+  char *args[] = { "echo", "spawned", 0 };
+  struct spawnfa fa[2];
+  char buf[32];
+  int pid, fd, n, xstate;
+
+  unlink("spawnout");
+  fa[0].op = SPAWN_OPEN;
+  fa[0].fd = 1;
+  fa[0].omode = O_CREATE|O_WRONLY;
+  fa[0].path = "spawnout";
+  pid = spawn("echo", args, fa, 1);
+  if(pid < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  if(waitpid(pid, &xstate, 0) != pid || xstate != 0){
+    printf("%s: spawned child failed\n", s);
+    exit(1);
+  }
+  fd = open("spawnout", O_RDONLY);
+  if(fd < 0){
+    printf("%s: no output file\n", s);
+    exit(1);
+  }
+  n = read(fd, buf, sizeof(buf)-1);
+  close(fd);
+  unlink("spawnout");
+  if(n != 8 || memcmp(buf, "spawned\n", 8) != 0){
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+
+  if(spawn("nosuchprogram", args, 0, 0) != -1){
+    printf("%s: spawn of missing program succeeded\n", s);
+    exit(1);
+  }
+  fa[0].op = SPAWN_DUP2;
+  fa[0].fd = 1;
+  fa[0].oldfd = NOFILE-1;
+  if(spawn("echo", args, fa, 1) != -1){
+    printf("%s: spawn with bad dup2 succeeded\n", s);
+    exit(1);
+  }
+  fa[0].op = SPAWN_CLOSE;
+  fa[0].fd = NOFILE;
+  if(spawn("echo", args, fa, 1) != -1){
+    printf("%s: spawn with bad fd succeeded\n", s);
+    exit(1);
+  }
+  if(wait(0) != -1){
+    printf("%s: failed spawn left a child\n", s);
+    exit(1);
+  }
+}
+
+// getrusage() and procinfo() count CPU time, I/O and memory.
+void
+rusagetest(char *s)
+{
+  struct rusage r0, r1;
+  static struct procinfo pi[NPROC];
+  char buf[100];
+  int fd, pid, n, t0, found;
+
+  if(getrusage(RUSAGE_SELF, &r0) < 0 || getrusage(-1, &r0) != -1){
+    printf("%s: getrusage failed\n", s);
+    exit(1);
+  }
+  getrusage(RUSAGE_SELF, &r0);
+  fd = open("rusagefile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("rusagefile", O_RDONLY);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("rusagefile");
+  sbrk(10*PGSIZE);
+  t0 = uptime();
+  while(uptime() < t0 + 3)
+    ;
+  getrusage(RUSAGE_SELF, &r1);
+  if(r1.wbytes - r0.wbytes < sizeof(buf) || r1.rbytes - r0.rbytes < sizeof(buf)){
+    printf("%s: I/O not counted\n", s);
+    exit(1);
+  }
+  if(r1.utime + r1.stime <= r0.utime + r0.stime){
+    printf("%s: CPU time not counted\n", s);
+    exit(1);
+  }
+  if(r1.maxsz < (uint64)sbrk(0)){
+    printf("%s: peak size not counted\n", s);
+    exit(1);
+  }
+  sbrk(-10*PGSIZE);
+
+  getrusage(RUSAGE_CHILDREN, &r0);
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    int fds[2];
+    pipe(fds);
+    write(fds[1], buf, sizeof(buf));
+    exit(0);
+  }
+  wait(0);
+  getrusage(RUSAGE_CHILDREN, &r1);
+  if(r1.wbytes - r0.wbytes < sizeof(buf)){
+    printf("%s: child's usage not counted\n", s);
+    exit(1);
+  }
+
+  n = procinfo(pi, NPROC);
+  found = 0;
+  for(int i = 0; i < n; i++)
+    if(pi[i].pid == getpid() && pi[i].sz == (uint64)sbrk(0))
+      found = 1;
+  if(n <= 0 || !found){
+    printf("%s: procinfo doesn't list us\n", s);
+    exit(1);
+  }
+}
+
+// the kprof device records samples while it is on.
+void
+kproftest(char *s)
+{
+  static struct ksample buf[64];
+  int fd, n, t0, mine;
+
+  fd = open("kprof", O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot open kprof\n", s);
+    exit(1);
+  }
+  while(read(fd, buf, sizeof(buf)) > 0)
+    ;
+  write(fd, "1", 1);
+  t0 = uptime();
+  while(uptime() < t0 + 3)
+    ;
+  write(fd, "0", 1);
+  mine = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    if(n % sizeof(buf[0]) != 0){
+      printf("%s: partial sample\n", s);
+      exit(1);
+    }
+    for(int i = 0; i < n / sizeof(buf[0]); i++)
+      if(buf[i].pid == getpid() && buf[i].depth >= 1)
+        mine++;
+  }
+  close(fd);
+  if(mine == 0){
+    printf("%s: no samples of this process\n", s);
+    exit(1);
+  }
+}
+
+// the ktrace device records system calls while they are enabled.
+void
+ktracetest(char *s)
+{
+  static struct tevent buf[64];
+  int fd, n, calls, rets, pid;
+
+  fd = open("ktrace", O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot open ktrace\n", s);
+    exit(1);
+  }
+  while(read(fd, buf, sizeof(buf)) > 0)
+    ;
+  write(fd, "32", 2);   // TC_SYSCALL
+  pid = getpid();
+  write(fd, "0", 1);
+  calls = rets = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    if(n % sizeof(buf[0]) != 0){
+      printf("%s: partial event\n", s);
+      exit(1);
+    }
+    for(int i = 0; i < n / sizeof(buf[0]); i++){
+      if(buf[i].pid != pid || buf[i].arg0 != SYS_getpid)
+        continue;
+      if(buf[i].type == TE_SYSCALL)
+        calls++;
+      if(buf[i].type == TE_SYSRET && buf[i].arg1 == pid)
+        rets++;
+    }
+  }
+  close(fd);
+  if(calls != 1 || rets != 1){
+    printf("%s: getpid traced %d/%d times\n", s, calls, rets);
+    exit(1);
+  }
+}
+
+// scstats() counts every system call and its latency.
+void
+scstatstest(char *s)
+{
+  static struct scstat before[SYS_getpid+1], after[SYS_getpid+1];
+  static struct scstat all[SYS_sched_setaffinity+1];
+  uint64 n;
+  int i;
+
+  if(scstats(before, SYS_getpid+1) <= SYS_getpid){
+    printf("%s: scstats failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 10; i++)
+    getpid();
+  scstats(after, SYS_getpid+1);
+  if(strcmp(after[SYS_getpid].name, "getpid") != 0){
+    printf("%s: wrong name %s\n", s, after[SYS_getpid].name);
+    exit(1);
+  }
+  if(after[SYS_getpid].count - before[SYS_getpid].count < 10){
+    printf("%s: getpid not counted\n", s);
+    exit(1);
+  }
+  n = 0;
+  for(i = 0; i < NSCHIST; i++)
+    n += after[SYS_getpid].hist[i] - before[SYS_getpid].hist[i];
+  if(n < 10){
+    printf("%s: getpid latencies not counted\n", s);
+    exit(1);
+  }
+
+  // the longest names fit.
+  if(scstats(all, SYS_sched_setaffinity+1) <= SYS_sched_setaffinity ||
+     strcmp(all[SYS_sched_setaffinity].name, "sched_setaffinity") != 0){
+    printf("%s: sched_setaffinity misnamed\n", s);
+    exit(1);
+  }
+}
+
+// the buffer cache counts hits, and grows past NBUF.
+void
+bcstattest(char *s)
+{
+  struct bcstat before, after;
+  char buf[BSIZE];
+  int fd, i;
+
+  if(bcstat(&before) < 0 || before.nbuf < NBUF || before.nbuf > before.maxbuf){
+    printf("%s: bcstat failed\n", s);
+    exit(1);
+  }
+  fd = open("bcstat.tmp", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < 4; i++)
+    write(fd, buf, sizeof(buf));
+  close(fd);
+  for(i = 0; i < 2; i++){
+    fd = open("bcstat.tmp", O_RDONLY);
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+  }
+  unlink("bcstat.tmp");
+  bcstat(&after);
+  if(after.nhit - before.nhit < 4 || after.nmiss < before.nmiss){
+    printf("%s: hits not counted\n", s);
+    exit(1);
+  }
+  if(after.nreq < before.nreq || after.nreqblk < after.nreq ||
+     after.nreqblk > after.nreq * NBIOVEC){
+    printf("%s: disk requests miscounted\n", s);
+    exit(1);
+  }
+}
+
+// the buffers of chunks the cache grows by hold the blocks
+// read into them, and start out clean.
+void
+bcgrowtest(char *s)
+{
+  struct bcstat st;
+  char buf[BSIZE];
+  int fd, i, j, n = NBUF + 10;
+
+  fd = open("bcgrow.tmp", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    buf[0] = i;
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  for(j = 0; j < 2; j++){
+    fd = open("bcgrow.tmp", O_RDONLY);
+    for(i = 0; i < n; i++){
+      if(read(fd, buf, sizeof(buf)) != sizeof(buf) || buf[0] != (char)i ||
+         buf[BSIZE-1] != 'a' + i % 26){
+        printf("%s: wrong data in block %d\n", s, i);
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+  unlink("bcgrow.tmp");
+  if(bcstat(&st) < 0 || st.nbuf <= NBUF){
+    printf("%s: cache didn't grow\n", s);
+    exit(1);
+  }
+}
+
+// enough transactions to go round the log several times
+// checkpoint it, and leave the files as written.
+void
+logwraptest(char *s)
+{
+  struct iostat before, after;
+  char buf[64];
+  int fd, i;
+
+  iostat(&before);
+  for(i = 0; i < 200; i++){
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    if((fd = open("logwrap", O_CREATE|O_WRONLY|O_TRUNC)) < 0 ||
+       write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write %d failed\n", s, i);
+      exit(1);
+    }
+    close(fd);
+    memset(buf, 0, sizeof(buf));
+    if((fd = open("logwrap", O_RDONLY)) < 0 ||
+       read(fd, buf, sizeof(buf)) != sizeof(buf) ||
+       buf[0] != 'a' + i % 26 || buf[sizeof(buf)-1] != 'a' + i % 26){
+      printf("%s: read %d back wrong\n", s, i);
+      exit(1);
+    }
+    close(fd);
+  }
+  unlink("logwrap");
+  iostat(&after);
+  if(after.log.ncheckpoint == before.log.ncheckpoint ||
+     after.log.nckblk <= before.log.nckblk){
+    printf("%s: no checkpoints\n", s);
+    exit(1);
+  }
+}
+
+// processes creating files at once, while others' commits
+// freeze the blocks they share, all see what they wrote.
+void
+groupcommittest(char *s)
+{
+  char name[] = "gc??", buf[64];
+  int fd, p, i, xstatus;
+
+  for(p = 0; p < 4; p++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      name[2] = 'a' + p;
+      for(i = 0; i < 10; i++){
+        name[3] = '0' + i;
+        memset(buf, 'a' + p + i, sizeof(buf));
+        if((fd = open(name, O_CREATE|O_RDWR)) < 0 ||
+           write(fd, buf, sizeof(buf)) != sizeof(buf)){
+          printf("%s: create %s failed\n", s, name);
+          exit(1);
+        }
+        close(fd);
+      }
+      exit(0);
+    }
+  }
+  for(p = 0; p < 4; p++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  for(p = 0; p < 4; p++){
+    name[2] = 'a' + p;
+    for(i = 0; i < 10; i++){
+      name[3] = '0' + i;
+      memset(buf, 0, sizeof(buf));
+      if((fd = open(name, O_RDONLY)) < 0 ||
+         read(fd, buf, sizeof(buf)) != sizeof(buf) ||
+         buf[0] != 'a' + p + i || buf[sizeof(buf)-1] != 'a' + p + i){
+        printf("%s: %s reads back wrong\n", s, name);
+        exit(1);
+      }
+      close(fd);
+      unlink(name);
+    }
+  }
+}
+
+// iostat() counts commits and disk requests.
+void
+iostattest(char *s)
+{
+  struct iostat before, after;
+  char buf[BSIZE];
+  int fd, i;
+  uint64 hist = 0;
+
+  if(iostat(&before) < 0){
+    printf("%s: iostat failed\n", s);
+    exit(1);
+  }
+  fd = open("iostat.tmp", O_CREATE|O_RDWR);
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < 4; i++)
+    write(fd, buf, sizeof(buf));
+  close(fd);
+  unlink("iostat.tmp");
+  iostat(&after);
+  for(i = 0; i < NIOHIST; i++)
+    hist += after.disk.hist[i];
+  if(after.log.ncommit < before.log.ncommit + 4 ||
+     after.log.nblk < after.log.ncommit ||
+     after.disk.nwrite <= before.disk.nwrite ||
+     after.disk.nblk < after.disk.nread + after.disk.nwrite ||
+     after.disk.depth < 0 || after.disk.maxdepth < 1 ||
+     hist + after.disk.depth != after.disk.nread + after.disk.nwrite){
+    printf("%s: wrong counts\n", s);
+    exit(1);
+  }
+}
+
+// bcctl() checks its arguments, and the cache works under 2Q.
+void
+bcctltest(char *s)
+{
+  struct bcstat st, st2;
+  char buf[BSIZE];
+  int fd, i, j;
+
+  bcstat(&st);
+  if(bcctl(BC_2Q + 1, -1) != -1 || bcctl(-1, MINBUF - 1) != -1){
+    printf("%s: bcctl accepted bad arguments\n", s);
+    exit(1);
+  }
+  if(bcctl(BC_2Q, -1) < 0 || bcstat(&st2) < 0 || st2.policy != BC_2Q){
+    printf("%s: bcctl failed\n", s);
+    exit(1);
+  }
+  fd = open("bcctl.tmp", O_CREATE|O_RDWR);
+  for(i = 0; i < 20; i++){
+    memset(buf, 'a' + i, sizeof(buf));
+    write(fd, buf, sizeof(buf));
+  }
+  close(fd);
+  for(j = 0; j < 2; j++){
+    fd = open("bcctl.tmp", O_RDONLY);
+    for(i = 0; i < 20; i++){
+      if(read(fd, buf, sizeof(buf)) != sizeof(buf) || buf[0] != 'a' + i){
+        printf("%s: wrong data under 2q\n", s);
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+  unlink("bcctl.tmp");
+  bcctl(st.policy, -1);
+}
+
+// reads of a file with read-ahead, sequential and with two
+// descriptors taking turns, see the right data.
+void
+readaheadtest(char *s)
+{
+  static char buf[3*BSIZE];
+  int fd, fd1, fd2, i, n, off1, off2;
+  enum { NBLK = 40 };
+
+  fd = open("readahead.tmp", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NBLK; i++){
+    memset(buf, 'a' + i % 26, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  // odd-sized reads, straddling blocks.
+  fd = open("readahead.tmp", O_RDONLY);
+  for(off1 = 0; (n = read(fd, buf, BSIZE + 7)) > 0; off1 += n){
+    for(i = 0; i < n; i++){
+      if(buf[i] != 'a' + (off1 + i) / BSIZE % 26){
+        printf("%s: wrong data at %d\n", s, off1 + i);
+        exit(1);
+      }
+    }
+  }
+  close(fd);
+  if(off1 != NBLK*BSIZE){
+    printf("%s: read %d bytes\n", s, off1);
+    exit(1);
+  }
+
+  // fd2 starts halfway, so the inode sees jumps.
+  fd1 = open("readahead.tmp", O_RDONLY);
+  fd2 = open("readahead.tmp", O_RDONLY);
+  for(i = 0; i < NBLK/2; i++)
+    read(fd2, buf, BSIZE);
+  off1 = 0;
+  off2 = NBLK/2*BSIZE;
+  while(off2 < NBLK*BSIZE){
+    if(read(fd1, buf, BSIZE) != BSIZE || buf[0] != 'a' + off1 / BSIZE % 26 ||
+       read(fd2, buf+BSIZE, BSIZE) != BSIZE ||
+       buf[BSIZE] != 'a' + off2 / BSIZE % 26){
+      printf("%s: wrong data at %d/%d\n", s, off1, off2);
+      exit(1);
+    }
+    off1 += BSIZE;
+    off2 += BSIZE;
+  }
+  close(fd1);
+  close(fd2);
+  unlink("readahead.tmp");
+}
+
+// the lockstat device lists locks, most contended first.
+void
+lockstattest(char *s)
+{
+  static struct lockstat st[16];
+  int fd, n, i;
+
+  fd = open("lockstat", O_RDONLY);
+  if(fd < 0){
+    printf("%s: cannot open lockstat\n", s);
+    exit(1);
+  }
+  n = read(fd, st, sizeof(st));
+  close(fd);
+  if(n <= 0 || n % sizeof(st[0]) != 0){
+    printf("%s: read returned %d\n", s, n);
+    exit(1);
+  }
+  n /= sizeof(st[0]);
+  for(i = 0; i < n; i++){
+    if(st[i].name[0] == 0 || st[i].nacquire == 0 ||
+       st[i].ncontend > st[i].nacquire){
+      printf("%s: bad entry %d\n", s, i);
+      exit(1);
+    }
+    if(i > 0 && st[i].ncontend + st[i].nsleep + st[i].navoid >
+                st[i-1].ncontend + st[i-1].nsleep + st[i-1].navoid){
+      printf("%s: not sorted\n", s);
+      exit(1);
+    }
+  }
+}
+
+// a uring runs operations asynchronously, in kernel threads.
+void
+uringtest(char *s)
+{
+  struct uringbuf *u;
+  struct sqe *e;
+  struct cqe *c;
+  int fds[2], pid, xstatus;
+  char buf[8];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  u = uring_setup(2);
+  if(u == (struct uringbuf*)-1){
+    printf("%s: uring_setup failed\n", s);
+    exit(1);
+  }
+  if(uring_setup(2) != (struct uringbuf*)-1){
+    printf("%s: second uring_setup succeeded\n", s);
+    exit(1);
+  }
+
+  // a read from an empty pipe completes once we write to it.
+  e = &u->sq[u->sqtail % NSQE];
+  e->op = UR_READ;
+  e->fd = fds[0];
+  e->addr = (uint64)buf;
+  e->n = sizeof(buf);
+  e->off = -1;
+  e->data = 7;
+  u->sqtail++;
+  if(uring_enter(1, 0) != 1){
+    printf("%s: uring_enter failed\n", s);
+    exit(1);
+  }
+  if(u->cqhead != u->cqtail){
+    printf("%s: read from empty pipe completed\n", s);
+    exit(1);
+  }
+  write(fds[1], "hi", 2);
+  uring_enter(0, 1);
+  c = &u->cq[u->cqhead % NCQE];
+  if(u->cqhead == u->cqtail || c->data != 7 || c->res != 2 ||
+     buf[0] != 'h' || buf[1] != 'i'){
+    printf("%s: pipe read didn't complete\n", s);
+    exit(1);
+  }
+  u->cqhead++;
+
+  // exiting with a read still blocked must not hang.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    u = uring_setup(1);
+    if(u == (struct uringbuf*)-1)
+      exit(1);
+    e = &u->sq[u->sqtail % NSQE];
+    e->op = UR_READ;
+    e->fd = fds[0];
+    e->addr = (uint64)buf;
+    e->n = sizeof(buf);
+    e->off = -1;
+    u->sqtail++;
+    uring_enter(1, 0);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// uprof() samples the user pc of new children.
+void
+uproftest(char *s)
+{
+  struct usample buf[16];
+  int pid, n, mine;
+
+  if(uprofread(buf, 16) != -1){
+    printf("%s: uprofread without uprof\n", s);
+    exit(1);
+  }
+  if(uprof(1) < 0){
+    printf("%s: uprof failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    int t0 = uptime();
+    while(uptime() < t0 + 3)
+      ;
+    exit(0);
+  }
+  uprof(0);
+  wait(0);
+  mine = 0;
+  while((n = uprofread(buf, 16)) > 0)
+    for(int i = 0; i < n; i++)
+      if(buf[i].pid == pid && buf[i].pc < (uint64)sbrk(0))
+        mine++;
+  if(mine == 0){
+    printf("%s: no samples of the child\n", s);
+    exit(1);
+  }
+}
+
 // try to find races in the reparenting
 // code that handles a parent exiting
 // when it still has live children.
@@ -2687,6 +3721,26 @@ main(int argc, char *argv[])
     {pipe1, "pipe1"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
+    {waitpidtest, "waitpid"},
+    {threadtest, "thread"},
+    {nanosleeptest, "nanosleep"},
+    {sleepmany, "sleepmany"},
+    {affinitytest, "affinity"},
+    {spawntest, "spawn"},
+    {rusagetest, "rusage"},
+    {kproftest, "kprof"},
+    {ktracetest, "ktrace"},
+    {scstatstest, "scstats"},
+    {uringtest, "uring"},
+    {lockstattest, "lockstat"},
+    {bcstattest, "bcstat"},
+    {bcgrowtest, "bcgrow"},
+    {bcctltest, "bcctl"},
+    {iostattest, "iostat"},
+    {groupcommittest, "groupcommit"},
+    {logwraptest, "logwrap"},
+    {readaheadtest, "readahead"},
+    {uproftest, "uprof"},
     {rmdot, "rmdot"},
     {fourteen, "fourteen"},
     {bigfile, "bigfile"},
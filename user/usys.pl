@@ -36,3 +36,23 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("waitpid");
+entry("clone");
+entry("join");
+entry("nanosleep");
+entry("clock_gettime");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("hartstat");
+entry("spawn");
+entry("getrusage");
+entry("procinfo");
+entry("uprof");
+entry("uprofread");
+entry("strace");
+entry("scstats");
+entry("uring_setup");
+entry("uring_enter");
+entry("bcstat");
+entry("bcctl");
+entry("iostat");
@@ -19,11 +19,10 @@
 
 
 // 带参数列表，执行某个程序
+// 用 spawn() 直接创建子进程，不必像 fork() 那样先复制整个地址空间
 void run(char *program, char **args) {
-	if(fork() == 0) { // child exec
-		exec(program, args);
-		exit(0);
-	}
+	if(spawn(program, args, 0, 0) < 0)
+		fprintf(2, "xargs: exec %s failed\n", program);
 	return; // parent return
 }
 